@@ -5,6 +5,7 @@
 #include <chrono>
 #include <string>
 #include <regex>
+#include <bitset>
 #include <cmath>
 
 #include "TextEditor.h"
@@ -20,6 +21,14 @@
 #include <imgui/imgui.h> // for imGui::GetCurrentWindow()
 #include <imgui/imgui_internal.h>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define TEXTEDITOR_SSE2
+	#include <emmintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+	#endif
+#endif
+
 // TODO
 // - multiline comments vs single-line: latter is blocking start of a ML
 
@@ -37,10 +46,35 @@ bool equals(InputIt1 first1, InputIt1 last1,
 
 TextEditor::TextEditor()
 	: mLineSpacing(1.0f)
+	, mLineArena(new LineArena())
+	, mUndoBudget(8 * 1024 * 1024)
 	, mUndoIndex(0)
+	, mEditDepth(0)
+	, mEditUndoCount(0)
+	, mEditChanged(false)
+	, mVersion(0)
 	, mInsertSpaces(false)
 	, mTabSize(4)
 	, mAutocomplete(true)
+	, mACCandidatesValid(false)
+	, mACMatchLine(-1)
+	, mACDocumentChanged(false)
+	, mDocumentSymbolsEnabled(true)
+	, mSymbolsChanged(false)
+	, mSymbolRangeMin(0)
+	, mSymbolRangeMax(0)
+	, mSymbolGeneration(0)
+	, mSymbolBusy(false)
+	, mSymbolExit(false)
+	, mSymbolLineStart(0)
+	, mSymbolLineEnd(0)
+	, mBracketLineCount(0)
+	, mBracketLeaves(0)
+	, mBracketRangeMin(0)
+	, mBracketRangeMax(0)
+	, mHighlightBrackets(true)
+	, mBracketHighlight{ { -1, -1 }, { -1, -1 } }
+	, mBracketHighlightValid(false)
 	, mACOpened(false)
 	, mHighlightLine(true)
 	, mHorizontalScroll(true)
@@ -57,19 +91,38 @@ TextEditor::TextEditor()
 	, mTextStart(20.0f)
 	, mLeftMargin(DebugDataSpace + LineNumberSpace)
 	, mCursorPositionChanged(false)
-	, mColorRangeMin(0)
-	, mColorRangeMax(0)
+	, mVisibleLineStart(0)
+	, mVisibleLineEnd(0)
+	, mColorizerTimeBudget(2.0f)
+	, mIndexTimeBudget(2.0f)
 	, mSelectionMode(SelectionMode::Normal)
-	, mCheckComments(true)
+	, mCommentRangeMin(0)
+	, mCommentRangeMax(0)
+	, mScrollbarMarkerLines(0)
+	, mScrollbarMarkersDirty(true)
+	, mLineLayoutStart(0)
+	, mLineLayoutFont(nullptr)
+	, mLineLayoutFontSize(0.0f)
+	, mLineLayoutTabSize(0)
+	, mLineLayoutAdvance(0.0f)
+	, mLineLayoutMonospace(false)
+	, mLineLayoutPalette{}
+	, mLineLayoutDrawFlags(0)
+	, mLineLayoutWhitespaces(false)
+	, mLineLayoutColorizer(false)
 	, mLastClick(-1.0f)
 	, mHandleKeyboardInputs(true)
 	, mHandleMouseInputs(true)
 	, mIgnoreImGuiChild(false)
 	, mShowWhitespaces(false)
+	, mColorizerExit(false)
+	, mColorizerThreadCount(0)
+	, mColorizerLinesPerSecond(0.0)
 	, mDebugCurrentLineUpdated(false)
 	, mDebugCurrentLine(-1)
 	, mPath("")
 	, OnContentUpdate(nullptr)
+	, OnTextChange(nullptr)
 	, mFuncTooltips(true)
 	, mUIScale(1.0f)
 	, mUIFontSize(18.0f)
@@ -83,7 +136,17 @@ TextEditor::TextEditor()
 	, mSnippetTagSelected(0)
 	, mSidebar(true)
 	, mHasSearch(true)
-	, mReplaceIndex(0)
+	, mReplacePosition(0, 0)
+	, mFindFlags(0)
+	, mFindMatchTreeValid(false)
+	, mFindMatchCount(0)
+	, mFindRangeMin(0)
+	, mFindRangeMax(0)
+	, mSearchGeneration(0)
+	, mSearchBusy(false)
+	, mSearchExit(false)
+	, mSearchLineStart(0)
+	, mSearchLineEnd(0)
 	, mStartTime(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count())
 {
 	memset(mFindWord, 0, 256 * sizeof(char));
@@ -108,7 +171,7 @@ TextEditor::TextEditor()
 
 	SetPalette(GetDarkPalette());
 	SetLanguageDefinition(LanguageDefinition::HLSL());
-	mLines.push_back(Line());
+	mLines.push_back(CreateLine());
 
 	m_shortcuts = GetDefaultShortcuts();
 }
@@ -166,6 +229,7 @@ const std::vector<TextEditor::Shortcut> TextEditor::GetDefaultShortcuts()
 	ret[(int)TextEditor::ShortcutID::Find] = TextEditor::Shortcut(SDLK_f, -1, 0, 1, 0); // CTRL+F
 	ret[(int)TextEditor::ShortcutID::Replace] = TextEditor::Shortcut(SDLK_h, -1, 0, 1, 0); // CTRL+H
 	ret[(int)TextEditor::ShortcutID::FindNext] = TextEditor::Shortcut(SDLK_F3, -1, 0, 0, 0); // F3
+	ret[(int)TextEditor::ShortcutID::FindPrevious] = TextEditor::Shortcut(SDLK_F3, -1, 0, 0, 1); // SHIFT+F3
 	ret[(int)TextEditor::ShortcutID::DebugStep] = TextEditor::Shortcut(SDLK_F10, -1, 0, 0, 0); // F10
 	ret[(int)TextEditor::ShortcutID::DebugStepInto] = TextEditor::Shortcut(SDLK_F11, -1, 0, 0, 0); // F11
 	ret[(int)TextEditor::ShortcutID::DebugStepOut] = TextEditor::Shortcut(SDLK_F11, -1, 0, 0, 1); // SHIFT+F11
@@ -179,15 +243,710 @@ const std::vector<TextEditor::Shortcut> TextEditor::GetDefaultShortcuts()
 
 TextEditor::~TextEditor()
 {
+	if (mColorizerThread.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(mColorizerMutex);
+			mColorizerExit = true;
+		}
+		mColorizerCondition.notify_one();
+		mColorizerThread.join();
+	}
+	if (mSearchThread.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(mSearchMutex);
+			mSearchExit = true;
+		}
+		mSearchCondition.notify_all();
+		mSearchThread.join();
+	}
+	if (mSymbolThread.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(mSymbolMutex);
+			mSymbolExit = true;
+		}
+		mSymbolCondition.notify_one();
+		mSymbolThread.join();
+	}
+}
+
+TextEditor::LineArena::LineArena()
+	: mChunkCursor(nullptr)
+	, mChunkEnd(nullptr)
+	, mBytesUsed(0)
+	, mBytesReserved(0)
+{
+	memset(mFreeLists, 0, sizeof(mFreeLists));
+}
+TextEditor::LineArena::~LineArena()
+{
+	Reset();
+}
+int TextEditor::LineArena::mGetSizeClass(size_t aBytes)
+{
+	int sizeClass = 0;
+	size_t blockSize = MinBlockSize;
+	while (blockSize < aBytes) {
+		blockSize <<= 1;
+		sizeClass++;
+	}
+	return sizeClass;
+}
+void* TextEditor::LineArena::Allocate(size_t aBytes)
+{
+	if (aBytes == 0)
+		aBytes = 1;
+
+	int sizeClass = mGetSizeClass(aBytes);
+	size_t blockSize = MinBlockSize << sizeClass;
+
+	// too big for the pool -> give it its own allocation
+	if (sizeClass >= SizeClassCount) {
+		mBytesUsed += aBytes;
+		mBytesReserved += aBytes;
+		return ::operator new(aBytes);
+	}
+
+	mBytesUsed += blockSize;
+
+	// reuse a previously freed block
+	if (mFreeLists[sizeClass] != nullptr) {
+		void* block = mFreeLists[sizeClass];
+		mFreeLists[sizeClass] = *(void**)block;
+		return block;
+	}
+
+	if (mChunkCursor == nullptr || mChunkCursor + blockSize > mChunkEnd) {
+		// put the rest of the current chunk into the free lists so that it isn't wasted
+		while (mChunkCursor != nullptr && mChunkCursor + MinBlockSize <= mChunkEnd) {
+			int restClass = std::min<int>(mGetSizeClass(mChunkEnd - mChunkCursor + 1) - 1, SizeClassCount - 1);
+			*(void**)mChunkCursor = mFreeLists[restClass];
+			mFreeLists[restClass] = mChunkCursor;
+			mChunkCursor += MinBlockSize << restClass;
+		}
+
+		char* chunk = (char*)::operator new(ChunkSize);
+		mChunks.push_back(chunk);
+		mChunkCursor = chunk;
+		mChunkEnd = chunk + ChunkSize;
+		mBytesReserved += ChunkSize;
+	}
+
+	void* block = mChunkCursor;
+	mChunkCursor += blockSize;
+	return block;
+}
+void TextEditor::LineArena::Deallocate(void* aPtr, size_t aBytes)
+{
+	if (aPtr == nullptr)
+		return;
+	if (aBytes == 0)
+		aBytes = 1;
+
+	int sizeClass = mGetSizeClass(aBytes);
+	if (sizeClass >= SizeClassCount) {
+		mBytesUsed -= aBytes;
+		mBytesReserved -= aBytes;
+		::operator delete(aPtr);
+		return;
+	}
+
+	mBytesUsed -= MinBlockSize << sizeClass;
+	*(void**)aPtr = mFreeLists[sizeClass];
+	mFreeLists[sizeClass] = aPtr;
+}
+void TextEditor::LineArena::Reset()
+{
+	// every line must already be destroyed at this point
+	for (char* chunk : mChunks)
+		::operator delete(chunk);
+	mChunks.clear();
+
+	memset(mFreeLists, 0, sizeof(mFreeLists));
+	mChunkCursor = mChunkEnd = nullptr;
+	mBytesReserved = 0;
+	mBytesUsed = 0;
+}
+
+namespace
+{
+	// Thompson NFA built from the token regexes, only needed while compiling the TokenDFA
+	class TokenNFA {
+	public:
+		struct State
+		{
+			std::bitset<256> mChars;
+			int mNext = -1;				// target of a transition on mChars
+			std::vector<int> mEpsilon;	// in the order std::regex tries them
+			int mAccept = -1;			// index of the regex that matches in this state
+			int mPattern = -1;			// index of the regex the state belongs to, -1 - the shared start
+		};
+
+		struct Fragment
+		{
+			int mStart, mEnd;
+		};
+
+		std::vector<State> mStates;
+
+		// parses aRegex and adds it as another alternative reachable from state 0
+		bool Add(const std::string& aRegex, int aIndex)
+		{
+			if (mStates.empty())
+				NewState();
+
+			mPattern = aIndex;
+			mPos = aRegex.c_str();
+			mEnd = mPos + aRegex.size();
+
+			Fragment frag;
+			if (!ParseAlternation(frag) || mPos != mEnd)
+				return false;
+
+			mStates[0].mEpsilon.push_back(frag.mStart);
+			mStates[frag.mEnd].mAccept = aIndex;
+			return true;
+		}
+
+	private:
+		const char* mPos;
+		const char* mEnd;
+		int mPattern = -1;
+
+		int NewState()
+		{
+			mStates.emplace_back();
+			mStates.back().mPattern = mPattern;
+			return (int)mStates.size() - 1;
+		}
+		Fragment CharSet(const std::bitset<256>& aChars)
+		{
+			Fragment ret = { NewState(), NewState() };
+			mStates[ret.mStart].mChars = aChars;
+			mStates[ret.mStart].mNext = ret.mEnd;
+			return ret;
+		}
+
+		bool ParseAlternation(Fragment& aOut)
+		{
+			if (!ParseConcatenation(aOut))
+				return false;
+
+			while (mPos != mEnd && *mPos == '|') {
+				mPos++;
+
+				Fragment other;
+				if (!ParseConcatenation(other))
+					return false;
+
+				Fragment alt = { NewState(), NewState() };
+				mStates[alt.mStart].mEpsilon = { aOut.mStart, other.mStart };
+				mStates[aOut.mEnd].mEpsilon.push_back(alt.mEnd);
+				mStates[other.mEnd].mEpsilon.push_back(alt.mEnd);
+				aOut = alt;
+			}
+			return true;
+		}
+		bool ParseConcatenation(Fragment& aOut)
+		{
+			aOut.mStart = aOut.mEnd = NewState();
+			while (mPos != mEnd && *mPos != '|' && *mPos != ')') {
+				Fragment next;
+				if (!ParseRepetition(next))
+					return false;
+				mStates[aOut.mEnd].mEpsilon.push_back(next.mStart);
+				aOut.mEnd = next.mEnd;
+			}
+			return true;
+		}
+		bool ParseRepetition(Fragment& aOut)
+		{
+			if (!ParseAtom(aOut))
+				return false;
+
+			while (mPos != mEnd && (*mPos == '*' || *mPos == '+' || *mPos == '?')) {
+				char op = *mPos++;
+				if (mPos != mEnd && *mPos == '?')
+					return false; // lazy quantifiers
+
+				Fragment rep = { NewState(), NewState() };
+				mStates[rep.mStart].mEpsilon.push_back(aOut.mStart);
+				if (op != '+')
+					mStates[rep.mStart].mEpsilon.push_back(rep.mEnd);
+				if (op != '?')
+					mStates[aOut.mEnd].mEpsilon.push_back(aOut.mStart);
+				mStates[aOut.mEnd].mEpsilon.push_back(rep.mEnd);
+				aOut = rep;
+			}
+			return true;
+		}
+		bool ParseAtom(Fragment& aOut)
+		{
+			std::bitset<256> chars;
+			char c = *mPos++;
+
+			if (c == '(') {
+				if (mPos != mEnd && *mPos == '?') {
+					if (mPos + 1 >= mEnd || mPos[1] != ':')
+						return false; // lookaheads
+					mPos += 2;
+				}
+				if (!ParseAlternation(aOut) || mPos == mEnd || *mPos != ')')
+					return false;
+				mPos++;
+				return true;
+			}
+			else if (c == '[') {
+				if (!ParseClass(chars))
+					return false;
+			}
+			else if (c == '.') {
+				chars.set();
+				chars.reset('\n');
+				chars.reset('\r');
+			}
+			else if (c == '\\') {
+				if (!ParseEscape(chars))
+					return false;
+			}
+			else if (c == '^' || c == '$' || c == '{' || c == '}' || c == '*' || c == '+' || c == '?' || c == ')')
+				return false; // anchors, counted repetition and stray operators
+			else
+				chars.set((uint8_t)c);
+
+			aOut = CharSet(chars);
+			return true;
+		}
+		bool ParseEscape(std::bitset<256>& aChars)
+		{
+			if (mPos == mEnd)
+				return false;
+
+			char c = *mPos++;
+			switch (c) {
+			case 'd': case 'D': case 'w': case 'W': case 's': case 'S':
+			{
+				std::bitset<256> set;
+				for (int i = 0; i < 256; i++) {
+					bool in = false;
+					if (c == 'd' || c == 'D') in = i >= '0' && i <= '9';
+					else if (c == 'w' || c == 'W') in = (i >= '0' && i <= '9') || (i >= 'a' && i <= 'z') || (i >= 'A' && i <= 'Z') || i == '_';
+					else in = i == ' ' || (i >= '\t' && i <= '\r');
+					set[i] = in;
+				}
+				if (c == 'D' || c == 'W' || c == 'S')
+					set.flip();
+				aChars |= set;
+				return true;
+			}
+			case 't': aChars.set('\t'); return true;
+			case 'n': aChars.set('\n'); return true;
+			case 'r': aChars.set('\r'); return true;
+			case 'f': aChars.set('\f'); return true;
+			case 'v': aChars.set('\v'); return true;
+			case 'b': case 'B': case 'x': case 'u': case 'c': return false; // word boundaries, character codes
+			default:
+				if (c >= '0' && c <= '9')
+					return false; // back references
+				aChars.set((uint8_t)c);
+				return true;
+			}
+		}
+		bool ParseClass(std::bitset<256>& aChars)
+		{
+			bool negate = mPos != mEnd && *mPos == '^';
+			if (negate)
+				mPos++;
+
+			while (mPos != mEnd && *mPos != ']') {
+				std::bitset<256> single;
+				int from = -1;
+				if (*mPos == '\\') {
+					mPos++;
+					if (!ParseEscape(single))
+						return false;
+					if (single.count() == 1)
+						for (int i = 0; i < 256; i++)
+							if (single[i]) from = i;
+				} else
+					single.set(from = (uint8_t)*mPos++);
+
+				// range
+				if (from != -1 && mPos + 1 < mEnd && *mPos == '-' && mPos[1] != ']') {
+					mPos++;
+					int to;
+					if (*mPos == '\\') {
+						mPos++;
+						std::bitset<256> last;
+						if (!ParseEscape(last) || last.count() != 1)
+							return false;
+						for (to = 0; !last[to]; to++);
+					} else
+						to = (uint8_t)*mPos++;
+
+					if (to < from)
+						return false;
+					for (int i = from; i <= to; i++)
+						single.set(i);
+				}
+
+				aChars |= single;
+			}
+
+			if (mPos == mEnd)
+				return false;
+			mPos++;
+
+			if (negate)
+				aChars.flip();
+			return true;
+		}
+	};
+}
+
+TextEditor::TokenDFA::TokenDFA()
+	: mClassCount(0)
+{
+	memset(mClasses, 0, sizeof(mClasses));
+}
+
+void TextEditor::TokenDFA::Clear()
+{
+	mClassCount = 0;
+	mTransitions.clear();
+	mAccepting.clear();
+	mColors.clear();
+}
+
+bool TextEditor::TokenDFA::Compile(const LanguageDefinition::TokenRegexStrings& aRegexStrings)
+{
+	Clear();
+
+	if (aRegexStrings.empty() || aRegexStrings.size() > MaxPatterns)
+		return false;
+
+	TokenNFA nfa;
+	for (size_t i = 0; i < aRegexStrings.size(); i++) {
+		if (!nfa.Add(aRegexStrings[i].first, (int)i))
+			return false;
+		mColors.push_back(aRegexStrings[i].second);
+	}
+
+	// characters that every NFA transition treats the same way share one column in the table
+	std::map<std::vector<bool>, int> classIds;
+	for (int c = 0; c < 256; c++) {
+		std::vector<bool> signature(nfa.mStates.size());
+		for (size_t s = 0; s < nfa.mStates.size(); s++)
+			signature[s] = nfa.mStates[s].mChars[c];
+
+		auto it = classIds.insert(std::make_pair(signature, (int)classIds.size())).first;
+		mClasses[c] = (uint8_t)it->second;
+	}
+	mClassCount = (int)classIds.size();
+
+	std::vector<int> classChar(mClassCount);
+	for (int c = 255; c >= 0; c--)
+		classChar[mClasses[c]] = c;
+
+	// subset construction over ordered sets: the NFA states are kept in the order a backtracking
+	// std::regex would reach them, and the states of a regex that come after one where it matches
+	// are dropped since std::regex would have stopped there, so only better matches can follow
+	auto closure = [&](std::vector<int>& aSet) {
+		std::vector<int> seeds;
+		seeds.swap(aSet);
+		std::vector<bool> seen(nfa.mStates.size());
+		std::vector<int> stack;
+		uint32_t accepted = 0;
+		for (int seed : seeds) {
+			stack.push_back(seed);
+			while (!stack.empty()) {
+				int s = stack.back();
+				stack.pop_back();
+				const auto& state = nfa.mStates[s];
+				if (seen[s] || (state.mPattern != -1 && (accepted & (1u << state.mPattern)) != 0))
+					continue;
+
+				seen[s] = true;
+				aSet.push_back(s);
+				if (state.mAccept != -1)
+					accepted |= 1u << state.mAccept;
+				for (auto it = state.mEpsilon.rbegin(); it != state.mEpsilon.rend(); ++it)
+					stack.push_back(*it);
+			}
+		}
+	};
+
+	std::map<std::vector<int>, int> stateIds;
+	std::vector<std::vector<int>> states;
+
+	std::vector<int> start = { 0 };
+	closure(start);
+	stateIds[start] = 0;
+	states.push_back(start);
+
+	for (size_t cur = 0; cur < states.size(); cur++) {
+		uint32_t accepting = 0;
+		for (int s : states[cur])
+			if (nfa.mStates[s].mAccept != -1)
+				accepting |= 1u << nfa.mStates[s].mAccept;
+		mAccepting.push_back(accepting);
+
+		for (int cls = 0; cls < mClassCount; cls++) {
+			std::vector<int> next;
+			for (int s : states[cur])
+				if (nfa.mStates[s].mNext != -1 && nfa.mStates[s].mChars[classChar[cls]])
+					next.push_back(nfa.mStates[s].mNext);
+
+			int target = -1;
+			if (!next.empty()) {
+				closure(next);
+				auto it = stateIds.find(next);
+				if (it == stateIds.end()) {
+					if (states.size() >= MaxStates) {
+						Clear();
+						return false;
+					}
+					it = stateIds.insert(std::make_pair(next, (int)states.size())).first;
+					states.push_back(next);
+				}
+				target = it->second;
+			}
+			mTransitions.push_back(target);
+		}
+	}
+
+	return true;
+}
+
+bool TextEditor::TokenDFA::Match(const char* aBegin, const char* aEnd, const char*& aOutEnd, PaletteIndex& aOutColor) const
+{
+	if (mTransitions.empty())
+		return false;
+
+	const char* matchEnd[MaxPatterns];
+	uint32_t matched = 0;
+	int state = 0;
+
+	for (const char* p = aBegin; p != aEnd; ) {
+		state = mTransitions[state * mClassCount + mClasses[(uint8_t)*p++]];
+		if (state < 0)
+			break;
+
+		uint32_t accepting = mAccepting[state];
+		matched |= accepting;
+		for (int i = 0; accepting != 0; i++, accepting >>= 1)
+			if (accepting & 1)
+				matchEnd[i] = p;
+	}
+
+	if (matched == 0)
+		return false;
+
+	int first = 0;
+	while ((matched & (1u << first)) == 0)
+		first++;
+
+	aOutEnd = matchEnd[first];
+	aOutColor = mColors[first];
+	return true;
+}
+
+void TextEditor::WordTable::Build(const LanguageDefinition& aLanguage)
+{
+	mCaseSensitive = aLanguage.mCaseSensitive;
+	mWords.clear();
+	mSeeds.clear();
+	mSlots.clear();
+
+	// tokens of case insensitive languages are compared in upper case, so words with
+	// lower case letters could never match
+	std::unordered_map<std::string, uint8_t> flags;
+	auto add = [&](const std::string& aWord, uint8_t aFlag) {
+		if (mCaseSensitive || std::none_of(aWord.begin(), aWord.end(), [](char c) { return c >= 'a' && c <= 'z'; }))
+			flags[aWord] |= aFlag;
+	};
+	for (const auto& keyword : aLanguage.mKeywords)
+		add(keyword, FlagKeyword);
+	for (const auto& ident : aLanguage.mIdentifiers)
+		add(ident.first, FlagIdentifier);
+	for (const auto& ident : aLanguage.mPreprocIdentifiers)
+		add(ident.first, FlagPreprocIdentifier);
+	if (flags.empty())
+		return;
+	mWords.assign(flags.begin(), flags.end());
+
+	// hash and displace: words are grouped into buckets by their hash, then every bucket
+	// (largest first) gets the first seed that moves all of its words into free slots
+	size_t bucketCount = 1, slotCount = 1;
+	while (bucketCount * 4 < mWords.size())
+		bucketCount *= 2;
+	while (slotCount < mWords.size() * 2)
+		slotCount *= 2;
+
+	std::vector<uint64_t> hashes(mWords.size());
+	for (size_t i = 0; i < mWords.size(); i++)
+		hashes[i] = Hash(mWords[i].first);
+
+	while (true) {
+		std::vector<std::vector<int>> buckets(bucketCount);
+		for (size_t i = 0; i < mWords.size(); i++)
+			buckets[(hashes[i] >> 32) & (bucketCount - 1)].push_back((int)i);
+
+		std::vector<int> order(bucketCount);
+		for (size_t i = 0; i < bucketCount; i++)
+			order[i] = (int)i;
+		std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return buckets[a].size() > buckets[b].size(); });
+
+		mSeeds.assign(bucketCount, 0);
+		mSlots.assign(slotCount, -1);
+
+		bool placed = true;
+		std::vector<size_t> taken;
+		for (int bucket : order) {
+			if (buckets[bucket].empty())
+				break;
+
+			uint32_t seed = 0;
+			for (; seed < 4096; seed++) {
+				taken.clear();
+				for (int word : buckets[bucket]) {
+					size_t slot = Slot(hashes[word], seed);
+					if (mSlots[slot] != -1 || std::find(taken.begin(), taken.end(), slot) != taken.end())
+						break;
+					taken.push_back(slot);
+				}
+				if (taken.size() == buckets[bucket].size())
+					break;
+			}
+			if (seed == 4096) {
+				placed = false;
+				break;
+			}
+
+			mSeeds[bucket] = seed;
+			for (size_t i = 0; i < taken.size(); i++)
+				mSlots[taken[i]] = buckets[bucket][i];
+		}
+		if (placed)
+			break;
+
+		// very unlikely, try again with more room
+		slotCount *= 2;
+		bucketCount *= 2;
+	}
+}
+
+uint64_t TextEditor::WordTable::Hash(std::string_view aWord) const
+{
+	// FNV-1a over the upper case characters for case insensitive languages, like the
+	// ::toupper that used to be applied to the token before the lookup
+	uint64_t hash = 14695981039346656037ull;
+	for (char c : aWord) {
+		if (!mCaseSensitive && c >= 'a' && c <= 'z')
+			c -= 'a' - 'A';
+		hash = (hash ^ (uint8_t)c) * 1099511628211ull;
+	}
+	return hash;
+}
+
+size_t TextEditor::WordTable::Slot(uint64_t aHash, uint32_t aSeed) const
+{
+	uint64_t x = aHash ^ (aSeed * 0x9E3779B97F4A7C15ull);
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+	return (size_t)(x ^ (x >> 31)) & (mSlots.size() - 1);
+}
+
+uint8_t TextEditor::WordTable::Find(std::string_view aWord) const
+{
+	if (mWords.empty())
+		return 0;
+
+	uint64_t hash = Hash(aWord);
+	int index = mSlots[Slot(hash, mSeeds[(hash >> 32) & (mSeeds.size() - 1)])];
+	if (index == -1)
+		return 0;
+
+	const std::string& word = mWords[index].first;
+	if (word.size() != aWord.size())
+		return 0;
+	for (size_t i = 0; i < word.size(); i++) {
+		char c = aWord[i];
+		if (!mCaseSensitive && c >= 'a' && c <= 'z')
+			c -= 'a' - 'A';
+		if (c != word[i])
+			return 0;
+	}
+	return mWords[index].second;
+}
+
+TextEditor::SharedLanguages& TextEditor::GetSharedLanguages()
+{
+	static SharedLanguages languages;
+	return languages;
+}
+
+std::shared_ptr<const TextEditor::LanguageDefinition> TextEditor::LanguageDefinition::Share(void(*aBuild)(LanguageDefinition&))
+{
+	auto langDef = std::make_shared<LanguageDefinition>();
+	aBuild(*langDef);
+
+	auto& shared = GetSharedLanguages();
+	std::lock_guard<std::mutex> lock(shared.mMutex);
+	shared.mLanguages[langDef.get()].mDefinition = langDef;
+	return langDef;
+}
+
+std::shared_ptr<const TextEditor::ColorizerLanguage> TextEditor::GetSharedColorizerLanguage(const std::shared_ptr<const LanguageDefinition>& aLanguageDef)
+{
+	auto& shared = GetSharedLanguages();
+	std::lock_guard<std::mutex> lock(shared.mMutex);
+
+	// forget definitions that nobody uses anymore, their address can be reused
+	for (auto it = shared.mLanguages.begin(); it != shared.mLanguages.end(); )
+		if (it->second.mDefinition.expired())
+			it = shared.mLanguages.erase(it);
+		else
+			++it;
+
+	auto& entry = shared.mLanguages[aLanguageDef.get()];
+	entry.mDefinition = aLanguageDef;
+	if (entry.mColorizer == nullptr) {
+		auto language = std::make_shared<ColorizerLanguage>();
+		language->mTokenize = aLanguageDef->mTokenize;
+		language->mCaseSensitive = aLanguageDef->mCaseSensitive;
+		language->mWords.Build(*aLanguageDef);
+
+		if (!language->mTokenDFA.Compile(aLanguageDef->mTokenRegexStrings))
+			for (auto& r : aLanguageDef->mTokenRegexStrings)
+				language->mRegexList.push_back(std::make_pair(std::regex(r.first, std::regex_constants::optimize), r.second));
+
+		entry.mColorizer = language;
+	}
+	return entry.mColorizer;
 }
 
 void TextEditor::SetLanguageDefinition(const LanguageDefinition & aLanguageDef)
 {
-	mLanguageDefinition = aLanguageDef;
-	mRegexList.clear();
+	// the built-in definitions are shared, anything else is copied once
+	std::shared_ptr<const LanguageDefinition> langDef;
+	{
+		auto& shared = GetSharedLanguages();
+		std::lock_guard<std::mutex> lock(shared.mMutex);
+		auto it = shared.mLanguages.find(&aLanguageDef);
+		if (it != shared.mLanguages.end())
+			langDef = it->second.mDefinition.lock();
+	}
+	if (langDef == nullptr)
+		langDef = std::make_shared<LanguageDefinition>(aLanguageDef);
 
-	for (auto& r : mLanguageDefinition.mTokenRegexStrings)
-		mRegexList.push_back(std::make_pair(std::regex(r.first, std::regex_constants::optimize), r.second));
+	SetLanguageDefinition(langDef);
+}
+
+void TextEditor::SetLanguageDefinition(const std::shared_ptr<const LanguageDefinition>& aLanguageDef)
+{
+	mLanguageDefinition = aLanguageDef;
+	mColorizerLanguage = GetSharedColorizerLanguage(aLanguageDef);
+	mACCandidatesValid = false;
 
 	Colorize();
 }
@@ -378,9 +1137,8 @@ void TextEditor::DeleteRange(const Coordinates & aStart, const Coordinates & aEn
 			RemoveLine(aStart.mLine + 1, aEnd.mLine + 1);
 	}
 
-	mTextChanged = true;
-	if (OnContentUpdate != nullptr)
-		OnContentUpdate(this);
+	NotifyTextChange(aStart, aEnd, aStart);
+	NotifyContentUpdate();
 }
 
 int TextEditor::InsertTextAt(Coordinates& /* inout */ aWhere, const char * aValue, bool indent)
@@ -397,6 +1155,7 @@ int TextEditor::InsertTextAt(Coordinates& /* inout */ aWhere, const char * aValu
 		else break;
 	}
 
+	const Coordinates start = aWhere;
 	int cindex = GetCharacterIndex(aWhere);
 	int totalLines = 0;
 	int autoIndent = autoIndentStart;
@@ -487,9 +1246,8 @@ int TextEditor::InsertTextAt(Coordinates& /* inout */ aWhere, const char * aValu
 		}
 	}
 
-	mTextChanged = true;
-	if (OnContentUpdate != nullptr)
-		OnContentUpdate(this);
+	NotifyTextChange(start, start, aWhere);
+	NotifyContentUpdate();
 
 	return totalLines;
 }
@@ -504,46 +1262,427 @@ void TextEditor::AddUndo(UndoRecord& aValue)
 	//	aValue.mAfter.mCursorPosition.mLine, aValue.mAfter.mCursorPosition.mColumn
 	//	);
 
-	mUndoBuffer.resize((size_t)(mUndoIndex + 1));
-	mUndoBuffer.back() = aValue;
+	// drop the redo history
+	if (mUndoIndex < (int)mUndoBuffer.size()) {
+		mUndoText.resize(mUndoBuffer[mUndoIndex].mRemovedOffset);
+		mUndoBuffer.resize((size_t)mUndoIndex);
+	}
+
+	bool grouped = mEditDepth > 0 && mEditUndoCount > 0;
+	mEditUndoCount++;
+
+	// the first step of an edit is kept apart until EndEdit knows whether more steps follow
+	if (mEditDepth == 0 && MergeUndo(aValue))
+		return;
+
+	UndoEntry entry;
+	entry.mRemovedOffset = (unsigned int)mUndoText.size();
+	entry.mRemovedLength = (unsigned int)aValue.mRemoved.size();
+	mUndoText += aValue.mRemoved;
+	entry.mAddedOffset = (unsigned int)mUndoText.size();
+	entry.mAddedLength = (unsigned int)aValue.mAdded.size();
+	mUndoText += aValue.mAdded;
+
+	entry.mAddedStart = aValue.mAddedStart;
+	entry.mAddedEnd = aValue.mAddedEnd;
+	entry.mRemovedStart = aValue.mRemovedStart;
+	entry.mRemovedEnd = aValue.mRemovedEnd;
+	entry.mBefore = aValue.mBefore;
+	entry.mAfter = aValue.mAfter;
+	entry.mMergeable = IsMergeableUndo(aValue);
+	entry.mGrouped = grouped;
+
+	mUndoBuffer.push_back(entry);
 	++mUndoIndex;
+
+	if (mEditDepth == 0)
+		TrimUndo();
 }
 
-TextEditor::Coordinates TextEditor::ScreenPosToCoordinates(const ImVec2& aPosition) const
+bool TextEditor::IsMergeableUndo(const UndoRecord& aValue) const
 {
-	ImVec2 origin = mUICursorPos;
-	ImVec2 local(aPosition.x - origin.x, aPosition.y - origin.y);
+	const bool isInsert = !aValue.mAdded.empty() && aValue.mRemoved.empty();
+	const bool isDelete = aValue.mAdded.empty() && !aValue.mRemoved.empty();
+	if (!isInsert && !isDelete)
+		return false;
 
-	int lineNo = std::max(0, (int)floor(local.y / mCharAdvance.y));
+	// only single (UTF-8) characters can be merged, new lines always start a new step
+	const std::string& text = isInsert ? aValue.mAdded : aValue.mRemoved;
+	return text.size() <= 6 && (int)text.size() == UTF8CharLength(text[0]) && text[0] != '\n' && text[0] != '\t';
+}
 
-	int columnCoord = 0;
+bool TextEditor::MergeUndo(UndoRecord& aValue)
+{
+	// consecutive single character inserts/deletes are stored as one step
+	if (mUndoBuffer.empty() || mUndoIndex != (int)mUndoBuffer.size() || !IsMergeableUndo(aValue))
+		return false;
 
-	if (lineNo >= 0 && lineNo < (int)mLines.size())
-	{
-		auto& line = mLines.at(lineNo);
+	UndoEntry& last = mUndoBuffer.back();
+	if (!last.mMergeable || last.mGrouped || last.mAfter.mCursorPosition != aValue.mBefore.mCursorPosition || last.mAfter.mSelectionStart != last.mAfter.mSelectionEnd)
+		return false;
 
-		int columnIndex = 0;
-		float columnX = 0.0f;
+	if (!aValue.mAdded.empty()) {
+		if (last.mRemovedLength != 0 || last.mAddedEnd != aValue.mAddedStart)
+			return false;
 
-		while ((size_t)columnIndex < line.size())
-		{
-			float columnWidth = 0.0f;
+		mUndoText += aValue.mAdded;
+		last.mAddedLength += (unsigned int)aValue.mAdded.size();
+		last.mAddedEnd = aValue.mAddedEnd;
+	} else {
+		if (last.mAddedLength != 0)
+			return false;
 
-			if (line[columnIndex].mChar == '\t')
-			{
-				float spaceSize = ImGui::GetFont()->CalcTextSizeA(ImGui::GetFontSize(), FLT_MAX, -1.0f, " ").x;
-				float oldX = columnX;
-				float newColumnX = (1.0f + std::floor((1.0f + columnX) / (float(mTabSize) * spaceSize))) * (float(mTabSize) * spaceSize);
-				columnWidth = newColumnX - oldX;
-				if (mTextStart + columnX + columnWidth * 0.5f > local.x)
-					break;
-				columnX = newColumnX;
-				columnCoord = (columnCoord / mTabSize) * mTabSize + mTabSize;
-				columnIndex++;
-			}
-			else
-			{
-				char buf[7];
+		if (aValue.mRemovedEnd == last.mRemovedStart) {
+			// backspace: the new text goes in front of what was removed so far
+			mUndoText.insert(last.mRemovedOffset, aValue.mRemoved);
+			last.mRemovedStart = aValue.mRemovedStart;
+		} else if (aValue.mRemovedStart == last.mRemovedStart && aValue.mRemovedStart.mLine == aValue.mRemovedEnd.mLine &&
+			last.mRemovedStart.mLine == last.mRemovedEnd.mLine && mUndoText.find_first_of("\t\n", last.mRemovedOffset) == std::string::npos) {
+			// forward delete: the removed range grows to the right
+			mUndoText += aValue.mRemoved;
+			last.mRemovedEnd.mColumn += aValue.mRemovedEnd.mColumn - aValue.mRemovedStart.mColumn;
+		} else
+			return false;
+
+		last.mRemovedLength += (unsigned int)aValue.mRemoved.size();
+		last.mAddedOffset = last.mRemovedOffset + last.mRemovedLength;
+	}
+
+	last.mAfter = aValue.mAfter;
+	return true;
+}
+
+void TextEditor::TrimUndo()
+{
+	if (mUndoBudget == 0 || GetUndoMemoryUsage() <= mUndoBudget)
+		return;
+
+	// evict a batch of the oldest steps at once so that the text buffer isn't shifted on every edit
+	size_t target = mUndoBudget - mUndoBudget / 4;
+	size_t usage = GetUndoMemoryUsage();
+	size_t count = 0;
+	while (count < (size_t)mUndoIndex && count + 1 < mUndoBuffer.size() && usage > target) {
+		const UndoEntry& entry = mUndoBuffer[count];
+		usage -= entry.mRemovedLength + entry.mAddedLength + sizeof(UndoEntry);
+		count++;
+	}
+
+	// never split a group of edits
+	while (count > 0 && mUndoBuffer[count].mGrouped)
+		count--;
+	if (count == 0)
+		return;
+
+	unsigned int textStart = mUndoBuffer[count].mRemovedOffset;
+	mUndoText.erase(0, textStart);
+	mUndoBuffer.erase(mUndoBuffer.begin(), mUndoBuffer.begin() + count);
+	for (auto& entry : mUndoBuffer) {
+		entry.mRemovedOffset -= textStart;
+		entry.mAddedOffset -= textStart;
+	}
+
+	mUndoIndex -= (int)count;
+}
+
+TextEditor::UndoRecord TextEditor::GetUndoRecord(int aIndex) const
+{
+	const UndoEntry& entry = mUndoBuffer[aIndex];
+
+	UndoRecord ret;
+	ret.mAdded = mUndoText.substr(entry.mAddedOffset, entry.mAddedLength);
+	ret.mAddedStart = entry.mAddedStart;
+	ret.mAddedEnd = entry.mAddedEnd;
+	ret.mRemoved = mUndoText.substr(entry.mRemovedOffset, entry.mRemovedLength);
+	ret.mRemovedStart = entry.mRemovedStart;
+	ret.mRemovedEnd = entry.mRemovedEnd;
+	ret.mBefore = entry.mBefore;
+	ret.mAfter = entry.mAfter;
+	return ret;
+}
+
+void TextEditor::SetUndoMemoryBudget(size_t aBytes)
+{
+	mUndoBudget = aBytes;
+	if (mEditDepth == 0)
+		TrimUndo();
+}
+
+void TextEditor::BeginEdit()
+{
+	if (mEditDepth++ == 0) {
+		mEditUndoCount = 0;
+		mEditChanged = false;
+	}
+}
+
+void TextEditor::EndEdit()
+{
+	assert(mEditDepth > 0);
+	if (--mEditDepth > 0)
+		return;
+
+	// an edit that made a single step may still join the typing before it
+	if (mEditUndoCount == 1 && !mUndoBuffer.empty() && mUndoIndex == (int)mUndoBuffer.size() && mUndoBuffer.back().mMergeable) {
+		UndoEntry entry = mUndoBuffer.back();
+		UndoRecord record = GetUndoRecord(mUndoIndex - 1);
+		mUndoText.resize(entry.mRemovedOffset);
+		mUndoBuffer.pop_back();
+		--mUndoIndex;
+		if (!MergeUndo(record)) {
+			mUndoText += record.mRemoved;
+			mUndoText += record.mAdded;
+			mUndoBuffer.push_back(entry);
+			++mUndoIndex;
+		}
+	}
+
+	TrimUndo();
+
+	if (!mEditChanges.empty()) {
+		std::vector<TextChange> changes;
+		changes.swap(mEditChanges);
+		if (OnTextChange != nullptr)
+			for (const auto& change : changes)
+				OnTextChange(this, change);
+	}
+
+	if (mEditChanged) {
+		mEditChanged = false;
+		if (OnContentUpdate != nullptr)
+			OnContentUpdate(this);
+	}
+}
+
+void TextEditor::NotifyTextChange(const Coordinates& aStart, const Coordinates& aRemovedEnd, const Coordinates& aInsertedEnd, bool aMoveDecorations)
+{
+	mVersion++;
+	if (aMoveDecorations)
+		MoveDecorations(aStart, aRemovedEnd, aInsertedEnd);
+
+	// keep the cached line states lined up with mLines, the changed lines are scanned again
+	int removedLines = aRemovedEnd.mLine - aStart.mLine;
+	int insertedLines = aInsertedEnd.mLine - aStart.mLine;
+	if (mLineStates.size() + insertedLines - removedLines == mLines.size() && aStart.mLine < (int)mLineStates.size()) {
+		auto at = mLineStates.begin() + aStart.mLine + 1;
+		at = mLineStates.erase(at, at + removedLines);
+		mLineStates.insert(at, insertedLines, LineStateInvalid);
+	} else
+		mLineStates.clear();
+	if (removedLines != insertedLines && mCommentRangeMax > aStart.mLine + 1)
+		mCommentRangeMax = std::max(aStart.mLine + 1, mCommentRangeMax + insertedLines - removedLines);
+	mCommentRangeMin = std::min<int>(mCommentRangeMin, aStart.mLine);
+	mCommentRangeMax = std::max<int>(mCommentRangeMax, aInsertedEnd.mLine + 1);
+
+	// same for the brackets
+	if (mBracketLineCount + insertedLines - removedLines == (int)mLines.size() && aStart.mLine < mBracketLineCount) {
+		if (removedLines != insertedLines) {
+			SpliceBracketLines(aStart.mLine + 1, removedLines, insertedLines);
+
+			if (mBracketRangeMax > aStart.mLine + 1)
+				mBracketRangeMax = std::max(aStart.mLine + 1, mBracketRangeMax + insertedLines - removedLines);
+		}
+		mBracketRangeMin = std::min(mBracketRangeMin, aStart.mLine);
+		mBracketRangeMax = std::max(mBracketRangeMax, aInsertedEnd.mLine + 1);
+	} else
+		mBracketLineCount = -1; // scanned again from scratch
+
+	// the lines of running colorizer jobs are colorized again wherever they end up
+	for (auto& lines : mColorizerLines) {
+		if (lines.first < lines.second)
+			AddColorRange(lines.first, lines.second);
+		lines = std::make_pair(0, 0);
+	}
+
+	// move the lines that still wait for colors along with the text
+	if (removedLines != insertedLines && !mColorRanges.empty()) {
+		auto moveLine = [&](int aLine) {
+			if (aLine <= aStart.mLine)
+				return aLine;
+			if (aLine <= aRemovedEnd.mLine)
+				return aInsertedEnd.mLine + 1;
+			return aLine + insertedLines - removedLines;
+		};
+		auto ranges = std::move(mColorRanges);
+		mColorRanges.clear();
+		for (const auto& range : ranges)
+			AddColorRange(moveLine(range.first), moveLine(range.second));
+	}
+	AddColorRange(aStart.mLine, aInsertedEnd.mLine + 1);
+	InvalidateLineLayouts(aStart.mLine, removedLines != insertedLines ? std::numeric_limits<int>::max() : aInsertedEnd.mLine + 1);
+
+	// the find matches move with the lines, the changed lines are searched again
+	if (mFindIndexMatcher != nullptr) {
+		// a search of the old text is abandoned and its lines are searched again
+		if (mSearchBusy && mSearchLineStart < mSearchLineEnd) {
+			mSearchGeneration++;
+			mFindRangeMin = std::min(mFindRangeMin, mSearchLineStart);
+			mFindRangeMax = std::max(mFindRangeMax, mSearchLineEnd);
+			mSearchLineStart = mSearchLineEnd = 0;
+		}
+		if (mFindMatches.size() + insertedLines - removedLines == mLines.size() && aRemovedEnd.mLine < (int)mFindMatches.size()) {
+			for (int i = aStart.mLine; i <= aRemovedEnd.mLine; i++) {
+				mFindMatchCount -= (int)mFindMatches[i].size();
+				AddFindMatches(i, -(int)mFindMatches[i].size());
+				mFindMatches[i].clear();
+			}
+			if (removedLines != insertedLines) {
+				auto at = mFindMatches.begin() + aStart.mLine + 1;
+				at = mFindMatches.erase(at, at + removedLines);
+				mFindMatches.insert(at, insertedLines, std::vector<FindMatch>());
+				mFindMatchTreeValid = false;
+
+				if (mFindRangeMax > aStart.mLine + 1)
+					mFindRangeMax = std::max(aStart.mLine + 1, mFindRangeMax + insertedLines - removedLines);
+			}
+			mFindRangeMin = std::min(mFindRangeMin, aStart.mLine);
+			mFindRangeMax = std::max(mFindRangeMax, aInsertedEnd.mLine + 1);
+		} else
+			mFindIndexMatcher.reset(); // built again from scratch
+	}
+
+	// same for the symbols of the lines
+	if (!mSymbolLines.empty()) {
+		if (mSymbolBusy && mSymbolLineStart < mSymbolLineEnd) {
+			mSymbolGeneration++;
+			mSymbolRangeMin = std::min(mSymbolRangeMin, mSymbolLineStart);
+			mSymbolRangeMax = std::max(mSymbolRangeMax, mSymbolLineEnd);
+			mSymbolLineStart = mSymbolLineEnd = 0;
+		}
+		if (mSymbolLines.size() + insertedLines - removedLines == mLines.size() && aRemovedEnd.mLine < (int)mSymbolLines.size()) {
+			for (int i = aStart.mLine; i <= aRemovedEnd.mLine; i++) {
+				CountSymbols(mSymbolLines[i], -1);
+				mSymbolLines[i] = LineSymbols();
+			}
+			if (removedLines != insertedLines) {
+				auto at = mSymbolLines.begin() + aStart.mLine + 1;
+				at = mSymbolLines.erase(at, at + removedLines);
+				mSymbolLines.insert(at, insertedLines, LineSymbols());
+
+				if (mSymbolRangeMax > aStart.mLine + 1)
+					mSymbolRangeMax = std::max(aStart.mLine + 1, mSymbolRangeMax + insertedLines - removedLines);
+			}
+			mSymbolRangeMin = std::min(mSymbolRangeMin, aStart.mLine);
+			mSymbolRangeMax = std::max(mSymbolRangeMax, aInsertedEnd.mLine + 1);
+			mSymbolsChanged = true;
+		} else
+			mSymbolLines.clear(); // scanned again from scratch
+	}
+
+	if (OnTextChange == nullptr)
+		return;
+
+	TextChange change;
+	change.mStart = aStart;
+	change.mRemovedEnd = aRemovedEnd;
+	change.mInsertedEnd = aInsertedEnd;
+	if (aStart != aInsertedEnd)
+		change.mInserted = GetText(aStart, aInsertedEnd);
+	change.mVersion = mVersion;
+
+	// inside of a transaction the changes are reported in order once it ends
+	if (mEditDepth > 0)
+		mEditChanges.push_back(std::move(change));
+	else
+		OnTextChange(this, change);
+}
+
+void TextEditor::MoveDecorations(const Coordinates& aStart, const Coordinates& aRemovedEnd, const Coordinates& aInsertedEnd)
+{
+	// the lines after the change move with it, a line that starts right where the change ends
+	// stays with its text when that text starts a line again
+	int removedLines = aRemovedEnd.mLine - aStart.mLine;
+	int insertedLines = aInsertedEnd.mLine - aStart.mLine;
+	int moved = aRemovedEnd.mColumn == 0 && aInsertedEnd.mColumn == 0 ? aRemovedEnd.mLine : aRemovedEnd.mLine + 1;
+	int kept = aStart.mLine + insertedLines + (aStart.mColumn == 0 && moved == aRemovedEnd.mLine ? 0 : 1); // lines below are rewritten in place
+	int delta = insertedLines - removedLines;
+	if (kept >= moved && delta == 0)
+		return;
+
+	if (mBreakpointLines.GetCount() > 0) {
+		std::vector<std::pair<int, int>> removed, shifted;
+		mBreakpointLines.Erase(kept, moved, &removed);
+		if (delta != 0 && (OnBreakpointRemove || OnBreakpointUpdate))
+			mBreakpointLines.GetRange(moved, std::numeric_limits<int>::max(), shifted);
+		mBreakpointLines.Shift(moved, delta);
+
+		// reported like removing and adding them again
+		for (const auto& bkpt : removed) {
+			mBreakpointData[bkpt.second] = Breakpoint();
+			mBreakpointFree.push_back(bkpt.second);
+		}
+		if (OnBreakpointRemove) {
+			for (const auto& bkpt : removed)
+				OnBreakpointRemove(this, bkpt.first + 1);
+			for (const auto& bkpt : shifted)
+				OnBreakpointRemove(this, bkpt.first + 1);
+		}
+		if (OnBreakpointUpdate)
+			for (const auto& bkpt : shifted)
+				OnBreakpointUpdate(this, bkpt.first + delta + 1, mBreakpointData[bkpt.second].mCondition, mBreakpointData[bkpt.second].mEnabled);
+	}
+
+	if (mErrorLines.GetCount() > 0) {
+		mErrorLines.Erase(kept, moved);
+		mErrorLines.Shift(moved, delta);
+	}
+	mScrollbarMarkersDirty |= mBreakpointLines.GetCount() > 0 || mErrorLines.GetCount() > 0;
+
+	for (size_t i = 0; i < mSnippetTagStart.size(); i++) {
+		if (mSnippetTagStart[i].mLine >= moved) {
+			mSnippetTagStart[i].mLine += delta;
+			mSnippetTagEnd[i].mLine += delta;
+		}
+	}
+}
+
+void TextEditor::NotifyContentUpdate()
+{
+	mTextChanged = true;
+
+	if (mEditDepth > 0)
+		mEditChanged = true;
+	else if (OnContentUpdate != nullptr)
+		OnContentUpdate(this);
+}
+
+TextEditor::Coordinates TextEditor::ScreenPosToCoordinates(const ImVec2& aPosition) const
+{
+	ImVec2 origin = mUICursorPos;
+	ImVec2 local(aPosition.x - origin.x, aPosition.y - origin.y);
+
+	int lineNo = std::max(0, (int)floor(local.y / mCharAdvance.y));
+
+	int columnCoord = 0;
+
+	int tabs;
+	if (auto layout = lineNo < (int)mLines.size() ? FindLineLayout(lineNo, true) : nullptr)
+		columnCoord = GetCharacterColumn(lineNo, HitTestLineLayout(lineNo, *layout, local.x - mTextStart, tabs));
+	else if (lineNo >= 0 && lineNo < (int)mLines.size())
+	{
+		auto& line = mLines.at(lineNo);
+
+		int columnIndex = 0;
+		float columnX = 0.0f;
+
+		while ((size_t)columnIndex < line.size())
+		{
+			float columnWidth = 0.0f;
+
+			if (line[columnIndex].mChar == '\t')
+			{
+				float spaceSize = ImGui::GetFont()->CalcTextSizeA(ImGui::GetFontSize(), FLT_MAX, -1.0f, " ").x;
+				float oldX = columnX;
+				float newColumnX = (1.0f + std::floor((1.0f + columnX) / (float(mTabSize) * spaceSize))) * (float(mTabSize) * spaceSize);
+				columnWidth = newColumnX - oldX;
+				if (mTextStart + columnX + columnWidth * 0.5f > local.x)
+					break;
+				columnX = newColumnX;
+				columnCoord = (columnCoord / mTabSize) * mTabSize + mTabSize;
+				columnIndex++;
+			}
+			else
+			{
+				char buf[7];
 				auto d = UTF8CharLength(line[columnIndex].mChar);
 				int i = 0;
 				while (i < 6 && d-- > 0)
@@ -570,7 +1709,11 @@ TextEditor::Coordinates TextEditor::MousePosToCoordinates(const ImVec2& aPositio
 	int columnCoord = 0;
 	int modifier = 0;
 
-	if (lineNo >= 0 && lineNo < (int)mLines.size()) {
+	int tabs;
+	if (auto layout = lineNo < (int)mLines.size() ? FindLineLayout(lineNo, true) : nullptr) {
+		columnCoord = GetCharacterColumn(lineNo, HitTestLineLayout(lineNo, *layout, local.x - mTextStart, tabs));
+		modifier = tabs * 3;
+	} else if (lineNo >= 0 && lineNo < (int)mLines.size()) {
 		auto& line = mLines.at(lineNo);
 
 		int columnIndex = 0;
@@ -730,6 +1873,10 @@ int TextEditor::GetCharacterIndex(const Coordinates& aCoordinates) const
 {
 	if (aCoordinates.mLine >= mLines.size())
 		return -1;
+	auto layout = FindLineLayout(aCoordinates.mLine, false);
+	if (layout != nullptr && layout->mMonospace)
+		return GetLayoutIndex(*layout, aCoordinates.mColumn);
+
 	auto& line = mLines[aCoordinates.mLine];
 	int c = 0;
 	int i = 0;
@@ -748,6 +1895,10 @@ int TextEditor::GetCharacterColumn(int aLine, int aIndex) const
 {
 	if (aLine >= mLines.size())
 		return 0;
+	auto layout = FindLineLayout(aLine, false);
+	if (layout != nullptr && layout->mMonospace)
+		return GetLayoutColumn(*layout, std::max(0, std::min(aIndex, layout->mGlyphCount)));
+
 	auto& line = mLines[aLine];
 	int col = 0;
 	int i = 0;
@@ -814,33 +1965,8 @@ void TextEditor::RemoveLine(int aStart, int aEnd)
 	assert(aEnd >= aStart);
 	assert(mLines.size() > (size_t)(aEnd - aStart));
 
-	ErrorMarkers etmp;
-	for (auto& i : mErrorMarkers)
-	{
-		ErrorMarkers::value_type e(i.first >= aStart ? i.first - 1 : i.first, i.second);
-		if (e.first >= aStart && e.first <= aEnd)
-			continue;
-		etmp.insert(e);
-	}
-	mErrorMarkers = std::move(etmp);
-
-	auto btmp = mBreakpoints;
-	mBreakpoints.clear();
-	for (auto i : btmp)
-	{
-		if (i.mLine >= aStart && i.mLine <= aEnd) {
-			RemoveBreakpoint(i.mLine);
-			continue;
-		}
-		AddBreakpoint(i.mLine >= aStart ? i.mLine - 1 : i.mLine, i.mCondition, i.mEnabled);
-	}
-
 	mLines.erase(mLines.begin() + aStart, mLines.begin() + aEnd);
 	assert(!mLines.empty());
-
-	mTextChanged = true;
-	if (OnContentUpdate != nullptr)
-		OnContentUpdate(this);
 }
 
 void TextEditor::RemoveLine(int aIndex)
@@ -848,53 +1974,15 @@ void TextEditor::RemoveLine(int aIndex)
 	assert(!mReadOnly);
 	assert(mLines.size() > 1);
 
-	ErrorMarkers etmp;
-	for (auto& i : mErrorMarkers)
-	{
-		ErrorMarkers::value_type e(i.first > aIndex ? i.first - 1 : i.first, i.second);
-		if (e.first - 1 == aIndex)
-			continue;
-		etmp.insert(e);
-	}
-	mErrorMarkers = std::move(etmp);
-
-	auto btmp = mBreakpoints;
-	mBreakpoints.clear();
-	for (auto i : btmp)
-	{
-		if (i.mLine == aIndex) {
-			RemoveBreakpoint(i.mLine);
-			continue;
-		}
-		AddBreakpoint(i.mLine >= aIndex ? i.mLine - 1 : i.mLine, i.mCondition, i.mEnabled);
-	}
-
 	mLines.erase(mLines.begin() + aIndex);
 	assert(!mLines.empty());
-
-	mTextChanged = true;
-	if (OnContentUpdate != nullptr)
-		OnContentUpdate(this);
 }
 
 TextEditor::Line& TextEditor::InsertLine(int aIndex)
 {
 	assert(!mReadOnly);
 
-	auto& result = *mLines.insert(mLines.begin() + aIndex, Line());
-
-	ErrorMarkers etmp;
-	for (auto& i : mErrorMarkers)
-		etmp.insert(ErrorMarkers::value_type(i.first >= aIndex ? i.first + 1 : i.first, i.second));
-	mErrorMarkers = std::move(etmp);
-
-	auto btmp = mBreakpoints;
-	mBreakpoints.clear();
-	for (auto i : btmp)
-		RemoveBreakpoint(i.mLine);
-	for (auto i : btmp)
-		AddBreakpoint(i.mLine >= aIndex ? i.mLine + 1 : i.mLine, i.mCondition, i.mEnabled);
-
+	auto& result = *mLines.insert(mLines.begin() + aIndex, CreateLine());
 	return result;
 }
 
@@ -1112,6 +2200,7 @@ void TextEditor::HandleKeyboardInputs()
 				break;
 				case ShortcutID::Find: mFindOpened = mHasSearch; mFindJustOpened = mHasSearch; mReplaceOpened = false; break;
 				case ShortcutID::Replace: mFindOpened = mHasSearch; mFindJustOpened = mHasSearch; mReplaceOpened = mHasSearch; break;
+				case ShortcutID::FindNext: case ShortcutID::FindPrevious: break; // handled by the find bar
 				case ShortcutID::DebugStep:
 					if (OnDebuggerAction)
 						OnDebuggerAction(this, TextEditor::DebugAction::Step);
@@ -1150,6 +2239,7 @@ void TextEditor::HandleKeyboardInputs()
 			{
 				auto c = (unsigned char)io.InputQueueCharacters[i];
 				if (c != 0 && (c == '\n' || c >= 32)) {
+					BeginEdit();
 					EnterCharacter((char)c, shift);
 					if (mIsSnippet) {
 						mSnippetTagLength++;
@@ -1171,7 +2261,7 @@ void TextEditor::HandleKeyboardInputs()
 								if (j != mSnippetTagSelected) {
 									SetSelection(mSnippetTagStart[j], mSnippetTagEnd[j]);
 									Backspace();
-									InsertText(curWord);
+									ReplaceSelection(curWord.c_str());
 									mSnippetTagEnd[j].mColumn = mSnippetTagStart[j].mColumn + mSnippetTagLength;
 								}
 							}
@@ -1181,6 +2271,7 @@ void TextEditor::HandleKeyboardInputs()
 						EnsureCursorVisible();
 						mSnippetTagPreviousLength = mSnippetTagLength;
 					}
+					EndEdit();
 					keyCount++;
 				}
 			}
@@ -1308,12 +2399,208 @@ void TextEditor::HandleMouseInputs()
 	}
 }
 
+TextEditor::LineDecorations::LineDecorations()
+	: mCount(0)
+{
+}
+
+void TextEditor::LineDecorations::Assign(const std::vector<std::pair<int, int>>& aSorted)
+{
+	mEntries.resize(aSorted.size());
+	int line = 0;
+	for (size_t i = 0; i < aSorted.size(); i++) {
+		mEntries[i].mGap = aSorted[i].first - line;
+		mEntries[i].mId = aSorted[i].second;
+		line = aSorted[i].first;
+	}
+	mCount = (int)aSorted.size();
+	Build();
+}
+
+void TextEditor::LineDecorations::Add(int aLine, int aId)
+{
+	int index = LowerBound(aLine);
+	Entry entry;
+	entry.mGap = aLine - (index > 0 ? GetLine(index - 1) : 0);
+	entry.mId = aId;
+	if (index < (int)mEntries.size())
+		mEntries[index].mGap -= entry.mGap;
+	mEntries.insert(mEntries.begin() + index, entry);
+	mCount++;
+	Build();
+}
+
+int TextEditor::LineDecorations::Remove(int aLine)
+{
+	Cursor cursor = Seek(aLine);
+	int id = Next(cursor, aLine);
+	if (id == -1)
+		return -1;
+
+	// the entry keeps its place until there are enough removed ones to compact
+	mEntries[cursor.mIndex].mId = -1;
+	mCount--;
+	Compact();
+	return id;
+}
+
+int TextEditor::LineDecorations::Find(int aLine) const
+{
+	Cursor cursor = Seek(aLine);
+	return Next(cursor, aLine);
+}
+
+void TextEditor::LineDecorations::Erase(int aFromLine, int aToLine, std::vector<std::pair<int, int>>* aOutRemoved)
+{
+	if (aFromLine >= aToLine)
+		return;
+
+	int first = LowerBound(aFromLine);
+	int last = LowerBound(aToLine);
+	if (first >= last)
+		return;
+
+	// the removed entries are moved up to the entry before them, out of the way of Shift()
+	int line = first > 0 ? GetLine(first - 1) : 0;
+	for (int i = first; i < last; i++) {
+		line += mEntries[i].mGap;
+		if (mEntries[i].mId != -1) {
+			if (aOutRemoved != nullptr)
+				aOutRemoved->push_back(std::make_pair(line, mEntries[i].mId));
+			mEntries[i].mId = -1;
+			mCount--;
+		}
+		if (mEntries[i].mGap != 0) {
+			if (last < (int)mEntries.size())
+				AddGap(last, mEntries[i].mGap);
+			AddGap(i, -mEntries[i].mGap);
+		}
+	}
+	Compact();
+}
+
+void TextEditor::LineDecorations::Shift(int aFromLine, int aDelta)
+{
+	int index = LowerBound(aFromLine);
+	if (aDelta != 0 && index < (int)mEntries.size()) {
+		assert(mEntries[index].mGap + aDelta >= 0);
+		AddGap(index, aDelta);
+	}
+}
+
+void TextEditor::LineDecorations::GetRange(int aFromLine, int aToLine, std::vector<std::pair<int, int>>& aOut) const
+{
+	aOut.clear();
+	for (Cursor cursor = Seek(aFromLine); cursor.mIndex < (int)mEntries.size() && cursor.mLine < aToLine; ) {
+		if (mEntries[cursor.mIndex].mId != -1)
+			aOut.push_back(std::make_pair(cursor.mLine, mEntries[cursor.mIndex].mId));
+		if (++cursor.mIndex < (int)mEntries.size())
+			cursor.mLine += mEntries[cursor.mIndex].mGap;
+	}
+}
+
+TextEditor::LineDecorations::Cursor TextEditor::LineDecorations::Seek(int aLine) const
+{
+	Cursor cursor;
+	cursor.mIndex = LowerBound(aLine);
+	cursor.mLine = cursor.mIndex < (int)mEntries.size() ? GetLine(cursor.mIndex) : std::numeric_limits<int>::max();
+	return cursor;
+}
+
+int TextEditor::LineDecorations::Next(Cursor& aCursor, int aLine) const
+{
+	int size = (int)mEntries.size();
+	while (aCursor.mIndex < size && (aCursor.mLine < aLine || mEntries[aCursor.mIndex].mId == -1)) {
+		if (aCursor.mLine > aLine)
+			return -1;
+		aCursor.mIndex++;
+		aCursor.mLine = aCursor.mIndex < size ? aCursor.mLine + mEntries[aCursor.mIndex].mGap : std::numeric_limits<int>::max();
+	}
+	return aCursor.mLine == aLine ? mEntries[aCursor.mIndex].mId : -1;
+}
+
+int TextEditor::LineDecorations::GetLine(int aIndex) const
+{
+	int line = 0;
+	for (int i = aIndex + 1; i > 0; i -= i & -i)
+		line += mTree[i];
+	return line;
+}
+
+int TextEditor::LineDecorations::LowerBound(int aLine) const
+{
+	// the gaps are never negative, so the lines can be searched through the tree
+	int size = (int)mEntries.size();
+	int index = 0, line = 0;
+	int step = 1;
+	while (step * 2 <= size)
+		step *= 2;
+	for (; step > 0; step /= 2) {
+		if (index + step <= size && line + mTree[index + step] < aLine) {
+			index += step;
+			line += mTree[index];
+		}
+	}
+	return index;
+}
+
+void TextEditor::LineDecorations::AddGap(int aIndex, int aDelta)
+{
+	mEntries[aIndex].mGap += aDelta;
+	for (int i = aIndex + 1; i < (int)mTree.size(); i += i & -i)
+		mTree[i] += aDelta;
+}
+
+void TextEditor::LineDecorations::Build()
+{
+	mTree.assign(mEntries.size() + 1, 0);
+	for (int i = 1; i < (int)mTree.size(); i++) {
+		mTree[i] += mEntries[i - 1].mGap;
+		int parent = i + (i & -i);
+		if (parent < (int)mTree.size())
+			mTree[parent] += mTree[i];
+	}
+}
+
+void TextEditor::LineDecorations::Compact()
+{
+	int removed = (int)mEntries.size() - mCount;
+	if (removed < 64 || removed < mCount)
+		return;
+
+	int gap = 0;
+	size_t count = 0;
+	for (const auto& entry : mEntries) {
+		gap += entry.mGap;
+		if (entry.mId != -1) {
+			mEntries[count].mGap = gap;
+			mEntries[count].mId = entry.mId;
+			count++;
+			gap = 0;
+		}
+	}
+	mEntries.resize(count);
+	Build();
+}
+
+void TextEditor::SetErrorMarkers(const ErrorMarkers& aMarkers)
+{
+	std::vector<std::pair<int, int>> lines;
+	lines.reserve(aMarkers.size());
+	mErrorMessages.clear();
+	for (const auto& marker : aMarkers) {
+		if (marker.first < 1)
+			continue;
+		lines.push_back(std::make_pair(marker.first - 1, (int)mErrorMessages.size()));
+		mErrorMessages.push_back(marker.second);
+	}
+	mErrorLines.Assign(lines);
+	mScrollbarMarkersDirty = true;
+}
+
 bool TextEditor::HasBreakpoint(int line)
 {
-	for (const auto& bkpt : mBreakpoints)
-		if (bkpt.mLine == line)
-			return true;
-	return false;
+	return mBreakpointLines.Find(line - 1) != -1;
 }
 void TextEditor::AddBreakpoint(int line, std::string condition, bool enabled)
 {
@@ -1327,33 +2614,101 @@ void TextEditor::AddBreakpoint(int line, std::string condition, bool enabled)
 	if (OnBreakpointUpdate)
 		OnBreakpointUpdate(this, line, condition, enabled);
 
-	mBreakpoints.push_back(bkpt);
+	int id = (int)mBreakpointData.size();
+	if (!mBreakpointFree.empty()) {
+		id = mBreakpointFree.back();
+		mBreakpointFree.pop_back();
+		mBreakpointData[id] = bkpt;
+	} else
+		mBreakpointData.push_back(bkpt);
+	mBreakpointLines.Add(line - 1, id);
+	mScrollbarMarkersDirty = true;
 }
 void TextEditor::RemoveBreakpoint(int line)
 {
-	for (int i = 0; i < mBreakpoints.size(); i++)
-		if (mBreakpoints[i].mLine == line) {
-			mBreakpoints.erase(mBreakpoints.begin() + i);
-			break;
-		}
+	int id = mBreakpointLines.Remove(line - 1);
+	if (id != -1) {
+		mBreakpointData[id] = Breakpoint();
+		mBreakpointFree.push_back(id);
+		mScrollbarMarkersDirty = true;
+	}
 	if (OnBreakpointRemove)
 		OnBreakpointRemove(this, line);
 }
 void TextEditor::SetBreakpointEnabled(int line, bool enable)
 {
-	for (int i = 0; i < mBreakpoints.size(); i++)
-		if (mBreakpoints[i].mLine == line) {
-			mBreakpoints[i].mEnabled = enable;
-			if (OnBreakpointUpdate)
-				OnBreakpointUpdate(this, line, mBreakpoints[i].mCondition, enable);
-			break;
-		}
+	int id = mBreakpointLines.Find(line - 1);
+	if (id != -1) {
+		mBreakpointData[id].mEnabled = enable;
+		if (OnBreakpointUpdate)
+			OnBreakpointUpdate(this, line, mBreakpointData[id].mCondition, enable);
+	}
 }
 TextEditor::Breakpoint& TextEditor::GetBreakpoint(int line)
 {
-	for (int i = 0; i < mBreakpoints.size(); i++)
-		if (mBreakpoints[i].mLine == line)
-			return mBreakpoints[i];
+	int id = mBreakpointLines.Find(line - 1);
+	if (id == -1) {
+		static Breakpoint none;
+		none = Breakpoint();
+		return none;
+	}
+	mBreakpointData[id].mLine = line;
+	return mBreakpointData[id];
+}
+const std::vector<TextEditor::Breakpoint>& TextEditor::GetBreakpoints()
+{
+	std::vector<std::pair<int, int>> lines;
+	mBreakpointLines.GetRange(0, std::numeric_limits<int>::max(), lines);
+	mBreakpoints.clear();
+	for (const auto& line : lines) {
+		mBreakpointData[line.second].mLine = line.first + 1;
+		mBreakpoints.push_back(mBreakpointData[line.second]);
+	}
+	return mBreakpoints;
+}
+
+void TextEditor::BuildScrollbarMarkers(int aRows)
+{
+	mScrollbarMarkerRows.assign(aRows, ScrollbarMarkerNone);
+	mScrollbarMarkerLines = (int)mLines.size();
+	mScrollbarMarkersDirty = false;
+	if (aRows <= 0)
+		return;
+
+	// several markers usually land on the same row, only the most severe one is kept
+	float rowsPerLine = (float)aRows / mScrollbarMarkerLines;
+	auto mark = [&](const LineDecorations& aDecorations, ScrollbarMarker aMarker) {
+		std::vector<std::pair<int, int>> lines;
+		aDecorations.GetRange(0, std::numeric_limits<int>::max(), lines);
+		for (const auto& line : lines) {
+			int row = std::min(aRows - 1, (int)std::round((line.first + 0.5f) * rowsPerLine));
+			mScrollbarMarkerRows[row] = std::max<uint8_t>(mScrollbarMarkerRows[row], aMarker);
+		}
+	};
+	mark(mBreakpointLines, ScrollbarMarkerBreakpoint);
+	mark(mErrorLines, ScrollbarMarkerError);
+}
+void TextEditor::RenderScrollbarMarkers(ImDrawList* aDrawList, const ImVec2& aMin, const ImVec2& aMax)
+{
+	int rows = (int)(aMax.y - aMin.y);
+	if (mScrollbarMarkersDirty || mScrollbarMarkerLines != (int)mLines.size() || rows != (int)mScrollbarMarkerRows.size())
+		BuildScrollbarMarkers(rows);
+
+	// a run of rows with the same marker is drawn as one rectangle, more severe markers are drawn last
+	const float markerHeight = 6.0f;
+	for (uint8_t marker = ScrollbarMarkerBreakpoint; marker <= ScrollbarMarkerError; marker++) {
+		ImU32 color = mPalette[(int)(marker == ScrollbarMarkerError ? PaletteIndex::ErrorMarker : PaletteIndex::Breakpoint)];
+		for (int row = 0; row < rows; row++) {
+			if (mScrollbarMarkerRows[row] != marker)
+				continue;
+
+			int end = row + 1;
+			while (end < rows && mScrollbarMarkerRows[end] == marker)
+				end++;
+			aDrawList->AddRectFilled(ImVec2(aMin.x, aMin.y + row), ImVec2(aMin.x + (aMax.x - aMin.x) * 0.4f, aMin.y + end - 1 + markerHeight), color);
+			row = end;
+		}
+	}
 }
 
 void TextEditor::RenderInternal(const char* aTitle)
@@ -1370,7 +2725,6 @@ void TextEditor::RenderInternal(const char* aTitle)
 		mPalette[i] = ImGui::ColorConvertFloat4ToU32(color);
 	}
 
-	assert(mLineBuffer.empty());
 	mFocused = ImGui::IsWindowFocused() || mFindFocused || mReplaceFocused;
 
 	auto contentSize = ImGui::GetWindowContentRegionMax();
@@ -1390,6 +2744,8 @@ void TextEditor::RenderInternal(const char* aTitle)
 	auto lineNo = (int)floor(scrollY / mCharAdvance.y);
 	auto globalLineMax = (int)mLines.size();
 	auto lineMax = std::max<int>(0, std::min<int>((int)mLines.size() - 1, lineNo + (int)floor((scrollY + contentSize.y) / mCharAdvance.y)));
+	mVisibleLineStart = lineNo;
+	mVisibleLineEnd = lineMax + 1;
 
 	// Deduce mTextStart by evaluating mLines size (global lineMax) plus two spaces as text width
 	char buf[16];
@@ -1400,6 +2756,20 @@ void TextEditor::RenderInternal(const char* aTitle)
 	if (!mLines.empty())
 	{
 		float spaceSize = ImGui::GetFont()->CalcTextSizeA(ImGui::GetFontSize(), FLT_MAX, -1.0f, " ", nullptr, nullptr).x;
+		UpdateLineLayouts(lineNo, lineMax + 1);
+
+		if (mPalette != mLineLayoutPalette || drawList->Flags != mLineLayoutDrawFlags || mShowWhitespaces != mLineLayoutWhitespaces || mColorizerEnabled != mLineLayoutColorizer) {
+			for (auto& layout : mLineLayouts)
+				layout.mVertexValid = false;
+			mLineLayoutPalette = mPalette;
+			mLineLayoutDrawFlags = drawList->Flags;
+			mLineLayoutWhitespaces = mShowWhitespaces;
+			mLineLayoutColorizer = mColorizerEnabled;
+		}
+
+		// decorations of the lines in view, in the same order
+		auto breakpointCursor = mBreakpointLines.Seek(lineNo);
+		auto errorCursor = mErrorLines.Seek(lineNo);
 
 		while (lineNo <= lineMax)
 		{
@@ -1407,8 +2777,8 @@ void TextEditor::RenderInternal(const char* aTitle)
 			ImVec2 textScreenPos = ImVec2(lineStartScreenPos.x + mTextStart, lineStartScreenPos.y);
 
 			auto& line = mLines[lineNo];
-			longest = std::max(mTextStart + TextDistanceToLineStart(Coordinates(lineNo, GetLineMaxColumn(lineNo))), longest);
-			auto columnNo = 0;
+			const auto& layout = GetLineLayout(lineNo);
+			longest = std::max(mTextStart + GetLayoutOffset(layout, layout.mGlyphCount), longest);
 			Coordinates lineStartCoord(lineNo, 0);
 			Coordinates lineEndCoord(lineNo, GetLineMaxColumn(lineNo));
 
@@ -1449,24 +2819,46 @@ void TextEditor::RenderInternal(const char* aTitle)
 				}
 			}
 
-			auto start = ImVec2(lineStartScreenPos.x + scrollX, lineStartScreenPos.y);
+			if (mFindIndexMatcher != nullptr && lineNo < (int)mFindMatches.size() && !mFindMatches[lineNo].empty()) {
+				unsigned int oldColor = mPalette[(int)PaletteIndex::Selection];
+				unsigned int alpha = (oldColor & 0xFF000000) >> 25;
+				unsigned int newColor = (oldColor & 0x00FFFFFF) | (alpha << 24);
 
-			// Draw error markers
-			auto errorIt = mErrorMarkers.find(lineNo + 1);
-			if (errorIt != mErrorMarkers.end())
-			{
-				auto end = ImVec2(lineStartScreenPos.x + contentSize.x + 2.0f * scrollX, lineStartScreenPos.y + mCharAdvance.y);
-				drawList->AddRectFilled(start, end, mPalette[(int)PaletteIndex::ErrorMarker]);
+				for (const auto& match : mFindMatches[lineNo]) {
+					ImVec2 vstart(textScreenPos.x + GetLayoutOffset(layout, match.mStart), lineStartScreenPos.y);
+					ImVec2 vend(textScreenPos.x + GetLayoutOffset(layout, match.mEnd), lineStartScreenPos.y + mCharAdvance.y);
+					drawList->AddRectFilled(vstart, vend, newColor);
+				}
+			}
+
+			if (mHighlightBrackets) {
+				for (const auto& bracket : mBracketHighlight) {
+					if (bracket.first == lineNo) {
+						ImVec2 vstart(textScreenPos.x + GetLayoutOffset(layout, bracket.second), lineStartScreenPos.y);
+						ImVec2 vend(textScreenPos.x + GetLayoutOffset(layout, bracket.second + 1), lineStartScreenPos.y + mCharAdvance.y);
+						drawList->AddRect(vstart, vend, (mPalette[(int)PaletteIndex::Default] & 0x00FFFFFFu) | 0x80000000u);
+					}
+				}
+			}
+
+			auto start = ImVec2(lineStartScreenPos.x + scrollX, lineStartScreenPos.y);
+
+			// Draw error markers
+			int error = mErrorLines.Next(errorCursor, lineNo);
+			if (error != -1)
+			{
+				auto end = ImVec2(lineStartScreenPos.x + contentSize.x + 2.0f * scrollX, lineStartScreenPos.y + mCharAdvance.y);
+				drawList->AddRectFilled(start, end, mPalette[(int)PaletteIndex::ErrorMarker]);
 
 				if (ImGui::IsMouseHoveringRect(lineStartScreenPos, end))
 				{
 					ImGui::BeginTooltip();
 					ImGui::PushStyleColor(ImGuiCol_Text, ImGui::ColorConvertU32ToFloat4(mPalette[(int)PaletteIndex::ErrorMessage]));
-					ImGui::Text("Error at line %d:", errorIt->first);
+					ImGui::Text("Error at line %d:", lineNo + 1);
 					ImGui::PopStyleColor();
 					ImGui::Separator();
 					ImGui::PushStyleColor(ImGuiCol_Text, ImGui::ColorConvertU32ToFloat4(mPalette[(int)PaletteIndex::ErrorMessage]));
-					ImGui::Text("%s", errorIt->second.c_str());
+					ImGui::Text("%s", mErrorMessages[error].c_str());
 					ImGui::PopStyleColor();
 					ImGui::EndTooltip();
 				}
@@ -1521,79 +2913,15 @@ void TextEditor::RenderInternal(const char* aTitle)
 			}
 
 			// Render colorized text
-			auto prevColor = line.empty() ? mPalette[(int)PaletteIndex::Default] : GetGlyphColor(line[0]);
-			ImVec2 bufferOffset;
-
-			for (int i = 0; i < line.size();)
-			{
-				auto& glyph = line[i];
-				auto color = GetGlyphColor(glyph);
-
-				if ((color != prevColor || glyph.mChar == '\t' || glyph.mChar == ' ') && !mLineBuffer.empty())
-				{
-					const ImVec2 newOffset(textScreenPos.x + bufferOffset.x, textScreenPos.y + bufferOffset.y);
-					drawList->AddText(newOffset, prevColor, mLineBuffer.c_str());
-					auto textSize = ImGui::GetFont()->CalcTextSizeA(ImGui::GetFontSize(), FLT_MAX, -1.0f, mLineBuffer.c_str(), nullptr, nullptr);
-					bufferOffset.x += textSize.x;
-					mLineBuffer.clear();
-				}
-				prevColor = color;
-
-				if (glyph.mChar == '\t')
-				{
-					auto oldX = bufferOffset.x;
-					bufferOffset.x = (1.0f + std::floor((1.0f + bufferOffset.x) / (float(mTabSize) * spaceSize))) * (float(mTabSize) * spaceSize);
-					++i;
-
-					if (mShowWhitespaces)
-					{
-						const auto s = ImGui::GetFontSize();
-						const auto x1 = textScreenPos.x + oldX + 1.0f;
-						const auto x2 = textScreenPos.x + bufferOffset.x - 1.0f;
-						const auto y = textScreenPos.y + bufferOffset.y + s * 0.5f;
-						const ImVec2 p1(x1, y);
-						const ImVec2 p2(x2, y);
-						const ImVec2 p3(x2 - s * 0.2f, y - s * 0.2f);
-						const ImVec2 p4(x2 - s * 0.2f, y + s * 0.2f);
-						drawList->AddLine(p1, p2, 0x90909090);
-						drawList->AddLine(p2, p3, 0x90909090);
-						drawList->AddLine(p2, p4, 0x90909090);
-					}
-				}
-				else if (glyph.mChar == ' ')
-				{
-					if (mShowWhitespaces)
-					{
-						const auto s = ImGui::GetFontSize();
-						const auto x = textScreenPos.x + bufferOffset.x + spaceSize * 0.5f;
-						const auto y = textScreenPos.y + bufferOffset.y + s * 0.5f;
-						drawList->AddCircleFilled(ImVec2(x, y), 1.5f, 0x80808080, 4);
-					}
-					bufferOffset.x += spaceSize;
-					i++;
-				}
-				else
-				{
-					auto l = UTF8CharLength(glyph.mChar);
-					while (l-- > 0)
-						mLineBuffer.push_back(line[i++].mChar);
-				}
-				++columnNo;
-			}
-
-			if (!mLineBuffer.empty())
-			{
-				const ImVec2 newOffset(textScreenPos.x + bufferOffset.x, textScreenPos.y + bufferOffset.y);
-				drawList->AddText(newOffset, prevColor, mLineBuffer.c_str());
-				mLineBuffer.clear();
-			}
+			RenderLineLayout(drawList, lineNo, textScreenPos, spaceSize);
 
 			// side bar bg
 			if (mSidebar) {
 				drawList->AddRectFilled(ImVec2(lineStartScreenPos.x + scrollX, lineStartScreenPos.y), ImVec2(lineStartScreenPos.x + scrollX + mTextStart - 5.0f, lineStartScreenPos.y + mCharAdvance.y), ImGui::GetColorU32(ImGuiCol_WindowBg));
 
 				// Draw breakpoints
-				if (HasBreakpoint(lineNo + 1) != 0) {
+				int breakpoint = mBreakpointLines.Next(breakpointCursor, lineNo);
+				if (breakpoint != -1) {
 					float radius = ImGui::GetFontSize() * 1.0f / 3.0f;
 					float startX = lineStartScreenPos.x + scrollX + radius + 2.0f;
 					float startY = lineStartScreenPos.y + radius + 4.0f;
@@ -1601,7 +2929,7 @@ void TextEditor::RenderInternal(const char* aTitle)
 					drawList->AddCircle(ImVec2(startX, startY), radius + 1, mPalette[(int)PaletteIndex::BreakpointOutline]);
 					drawList->AddCircleFilled(ImVec2(startX, startY), radius, mPalette[(int)PaletteIndex::Breakpoint]);
 
-					Breakpoint bkpt = GetBreakpoint(lineNo + 1);
+					const Breakpoint& bkpt = mBreakpointData[breakpoint];
 					if (!bkpt.mEnabled)
 						drawList->AddCircleFilled(ImVec2(startX, startY), radius - 1, mPalette[(int)PaletteIndex::BreakpointDisabled]);
 					else {
@@ -1660,66 +2988,28 @@ void TextEditor::RenderInternal(const char* aTitle)
 
 			double hoverTime = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - mLastHoverTime).count();
 			
-			if (hoverTime > 0.5 && (hoverChar == '(' || hoverChar == ')') && IsDebugging()) {
+			int matchLine, matchIndex;
+			if (hoverTime > 0.5 && (hoverChar == '(' || hoverChar == ')') && IsDebugging() &&
+				FindBracketMatch(hoverPosition.mLine, hoverPosition.mColumn, matchLine, matchIndex)) {
 				std::string expr = "";
 
-				int colStart = 0, rowStart = hoverPosition.mLine;
-				int bracketMatch = 0;
+				int rowStart = hoverPosition.mLine, colStart = hoverPosition.mColumn;
+				int rowEnd = matchLine, colEnd = matchIndex;
 				if (hoverChar == ')') {
-					int colIndex = hoverPosition.mColumn;
-					for (; rowStart >= 0; rowStart--) {
-						for (int i = colIndex; i >= 0; i--) {
-							char curChar = mLines[rowStart][i].mChar;
-							if (curChar == '(')
-								bracketMatch++;
-							else if (curChar == ')')
-								bracketMatch--;
-
-							if (!isspace(curChar) || curChar == ' ')
-								expr += curChar;
-
-							if (bracketMatch == 0) {
-								colStart = i - 1;
-								break;
-							}
-						}
-						if (bracketMatch == 0)
-							break;
-						if (rowStart != 0)
-							colIndex = mLines[rowStart - 1].size() - 1;
-					}
-					std::reverse(expr.begin(), expr.end());
-
-					if (rowStart <= 0)
-						colStart = -1;
-				} else if (hoverChar == '(') {
-					int colIndex = hoverPosition.mColumn;
-					colStart = hoverPosition.mColumn - 1;
-					for (int j = rowStart; j < mLines.size(); j++) {
-						for (int i = colIndex; i < mLines[j].size(); i++) {
-							char curChar = mLines[j][i].mChar;
-							if (curChar == '(')
-								bracketMatch++;
-							else if (curChar == ')')
-								bracketMatch--;
-
-							if (!isspace(curChar) || curChar == ' ')
-								expr += curChar;
-
-							if (bracketMatch == 0)
-								break;
-						}
+					std::swap(rowStart, rowEnd);
+					std::swap(colStart, colEnd);
+				}
 
-						if (bracketMatch == 0)
-							break;
-						if (j != 0)
-							colIndex = 0;
+				for (int j = rowStart; j <= rowEnd; j++) {
+					int to = j == rowEnd ? colEnd + 1 : (int)mLines[j].size();
+					for (int i = j == rowStart ? colStart : 0; i < to; i++) {
+						char curChar = mLines[j][i].mChar;
+						if (!isspace(curChar) || curChar == ' ')
+							expr += curChar;
 					}
-
-					if (rowStart >= mLines.size())
-						colStart = -1;
 				}
 
+				colStart--;
 				while (colStart >= 0 && isalnum(mLines[rowStart][colStart].mChar)) {
 					expr.insert(expr.begin(), mLines[rowStart][colStart].mChar);
 					colStart--;
@@ -1735,14 +3025,14 @@ void TextEditor::RenderInternal(const char* aTitle)
 			} else if (hoverTime > 0.2) {
 				auto id = GetWordAt(ScreenPosToCoordinates(ImGui::GetMousePos()));
 				if (!id.empty()) {
-					auto it = mLanguageDefinition.mIdentifiers.find(id);
-					if (it != mLanguageDefinition.mIdentifiers.end()) {
+					auto it = mLanguageDefinition->mIdentifiers.find(id);
+					if (it != mLanguageDefinition->mIdentifiers.end()) {
 						ImGui::BeginTooltip();
 						ImGui::TextUnformatted(it->second.mDeclaration.c_str());
 						ImGui::EndTooltip();
 					} else {
-						auto pi = mLanguageDefinition.mPreprocIdentifiers.find(id);
-						if (pi != mLanguageDefinition.mPreprocIdentifiers.end()) {
+						auto pi = mLanguageDefinition->mPreprocIdentifiers.find(id);
+						if (pi != mLanguageDefinition->mPreprocIdentifiers.end()) {
 							ImGui::BeginTooltip();
 							ImGui::TextUnformatted(pi->second.mDeclaration.c_str());
 							ImGui::EndTooltip();
@@ -1950,9 +3240,11 @@ void TextEditor::mAutocompleteSelect()
 
 	std::string entryText = mAutcompleteParse(acEntry.second, acStart);
 
+	BeginEdit();
 	SetSelection(acStart, acEnd);
 	Backspace();
-	InsertText(entryText, true);
+	ReplaceSelection(entryText.c_str(), true);
+	EndEdit();
 
 	if (mIsSnippet && mSnippetTagStart.size() > 0) {
 		SetSelection(mSnippetTagStart[0], mSnippetTagEnd[0]);
@@ -1966,6 +3258,106 @@ void TextEditor::mAutocompleteSelect()
 	mACOpened = false;
 }
 
+// bit per letter, digit and '_' in a lower case text, the last bit for every other character
+static uint64_t ACCharMask(const std::string& aText)
+{
+	uint64_t mask = 0;
+	for (char c : aText) {
+		if (c >= 'a' && c <= 'z')
+			mask |= 1ull << (c - 'a');
+		else if (c >= '0' && c <= '9')
+			mask |= 1ull << (26 + c - '0');
+		else if (c == '_')
+			mask |= 1ull << 36;
+		else
+			mask |= 1ull << 63;
+	}
+	return mask;
+}
+
+void TextEditor::BuildACCandidates()
+{
+	mACCandidates.clear();
+
+	auto add = [&](const std::string& aSearch, const std::string& aDisplay, const std::string& aValue, int aLineStart, int aLineEnd) {
+		ACCandidate candidate;
+		candidate.mKey = aSearch;
+		std::transform(candidate.mKey.begin(), candidate.mKey.end(), candidate.mKey.begin(), tolower);
+		candidate.mChars = ACCharMask(candidate.mKey);
+		candidate.mDisplay = aDisplay;
+		candidate.mValue = aValue;
+		candidate.mLineStart = aLineStart;
+		candidate.mLineEnd = aLineEnd;
+		candidate.mCount = 0;
+		mACCandidates.push_back(std::move(candidate));
+	};
+	const int anyLine = std::numeric_limits<int>::max();
+	std::string braces = mCompleteBraces ? "()" : "";
+
+	for (size_t i = 0; i < mACEntrySearch.size(); i++)
+		add(mACEntrySearch[i], mACEntries[i].first, mACEntries[i].second, -anyLine, anyLine);
+	for (const auto& func : mACFunctions) {
+		// arguments and locals around the function's body
+		for (const auto& str : func.second.Locals)
+			add(str, str, str, func.second.LineStart - 2, func.second.LineEnd + 1);
+		for (const auto& str : func.second.Arguments)
+			add(str, str, str, func.second.LineStart - 2, func.second.LineEnd + 1);
+		add(func.first, func.first, func.first + braces, -anyLine, anyLine);
+	}
+	for (const auto& str : mACUniforms)
+		add(str, str, str, -anyLine, anyLine);
+	for (const auto& str : mACGlobals)
+		add(str, str, str, -anyLine, anyLine);
+	for (const auto& str : mACUserTypes)
+		add(str, str, str, -anyLine, anyLine);
+	for (const auto& str : mLanguageDefinition->mKeywords)
+		add(str, str, str, -anyLine, anyLine);
+	for (const auto& str : mLanguageDefinition->mIdentifiers)
+		add(str.first, str.first, str.first + braces, -anyLine, anyLine);
+
+	// the document's own symbols and then its other words, most used first, unless they were added already
+	if (mDocumentSymbolsEnabled) {
+		std::unordered_set<std::string> added;
+		for (const auto& candidate : mACCandidates)
+			if (candidate.mLineStart == -anyLine)
+				added.insert(candidate.mDisplay);
+		auto addOnce = [&](const std::string& aName, const std::string& aValue) {
+			if (added.insert(aName).second)
+				add(aName, aName, aValue, -anyLine, anyLine);
+		};
+
+		for (const auto& func : mDocumentSymbols.mFunctions) {
+			for (const auto& str : func.second.Locals)
+				add(str, str, str, func.second.LineStart - 2, func.second.LineEnd + 1);
+			for (const auto& str : func.second.Arguments)
+				add(str, str, str, func.second.LineStart - 2, func.second.LineEnd + 1);
+			addOnce(func.first, func.first + braces);
+		}
+		for (const auto& str : mDocumentSymbols.mUniforms)
+			addOnce(str, str);
+		for (const auto& str : mDocumentSymbols.mGlobals)
+			addOnce(str, str);
+		for (const auto& str : mDocumentSymbols.mTypes)
+			addOnce(str, str);
+
+		std::vector<std::pair<int, const std::string*>> words;
+		for (const auto& count : mSymbolCounts)
+			if (added.count(count.first) == 0)
+				words.push_back(std::make_pair(count.second, &count.first));
+		std::sort(words.begin(), words.end(), [](const std::pair<int, const std::string*>& a, const std::pair<int, const std::string*>& b) {
+			return a.first != b.first ? a.first > b.first : *a.second < *b.second;
+		});
+		for (const auto& word : words) {
+			add(*word.second, *word.second, *word.second, -anyLine, anyLine);
+			mACCandidates.back().mCount = word.first;
+		}
+	}
+
+	mACCandidatesValid = true;
+	mACDocumentChanged = false;
+	mACMatchLine = -1;
+}
+
 void TextEditor::m_buildSuggestions(bool* keepACOpened)
 {
 	mACWord = GetWordUnderCursor();
@@ -1982,119 +3374,49 @@ void TextEditor::m_buildSuggestions(bool* keepACOpened)
 		mACIndex = 0;
 		mACSwitched = false;
 
-		struct ACEntry {
-			ACEntry(const std::string& str, const std::string& val, int loc)
-			{
-				DisplayString = str;
-				Value = val;
-				Location = loc;
-			}
-
-			std::string DisplayString;
-			std::string Value;
-			int Location;
-		};
-		std::vector<ACEntry> weights;
-
 		std::string acWord = mACWord;
 		std::transform(acWord.begin(), acWord.end(), acWord.begin(), tolower);
+		int line = mState.mCursorPosition.mLine;
 
-		// get the words
-		for (int i = 0; i < mACEntrySearch.size(); i++) {
-			std::string lwrStr = mACEntrySearch[i];
-			std::transform(lwrStr.begin(), lwrStr.end(), lwrStr.begin(), tolower);
-
-			size_t loc = lwrStr.find(acWord);
-			if (loc != std::string::npos)
-				weights.push_back(ACEntry(mACEntries[i].first, mACEntries[i].second, loc));
-		}
-		for (auto& func : mACFunctions) {
-			std::string lwrStr = func.first;
-			std::transform(lwrStr.begin(), lwrStr.end(), lwrStr.begin(), tolower);
-
-			// suggest arguments and locals
-			if (mState.mCursorPosition.mLine >= func.second.LineStart - 2 && mState.mCursorPosition.mLine <= func.second.LineEnd + 1) {
+		// a word that only grew can only match fewer candidates, so the previous matches are narrowed down
+		bool narrow = mACCandidatesValid && mACMatchLine == line && acWord.compare(0, mACMatchWord.size(), mACMatchWord) == 0;
 
-				// locals
-				for (auto& str : func.second.Locals) {
-					std::string lwrLoc = str;
-					std::transform(lwrLoc.begin(), lwrLoc.end(), lwrLoc.begin(), tolower);
+		// changes to the document's symbols are picked up once a new word is started
+		if (!mACCandidatesValid || (mACDocumentChanged && !narrow))
+			BuildACCandidates();
 
-					size_t loc = lwrLoc.find(acWord);
-					if (loc != std::string::npos)
-						weights.push_back(ACEntry(str, str, loc));
-				}
-
-				// arguments
-				for (auto& str : func.second.Arguments) {
-					std::string lwrLoc = str;
-					std::transform(lwrLoc.begin(), lwrLoc.end(), lwrLoc.begin(), tolower);
-
-					size_t loc = lwrLoc.find(acWord);
-					if (loc != std::string::npos)
-						weights.push_back(ACEntry(str, str, loc));
-				}
-			}
+		uint64_t chars = ACCharMask(acWord);
+		auto matches = [&](const ACCandidate& aCandidate) {
+			return (aCandidate.mChars & chars) == chars && aCandidate.mKey.find(acWord) != std::string::npos;
+		};
 
-			size_t loc = lwrStr.find(acWord);
-			if (loc != std::string::npos) {
-				std::string val = func.first;
-				if (mCompleteBraces) val += "()";
-				weights.push_back(ACEntry(func.first, val, loc));
+		if (narrow) {
+			size_t kept = 0;
+			for (int index : mACMatches)
+				if (matches(mACCandidates[index]))
+					mACMatches[kept++] = index;
+			mACMatches.resize(kept);
+		} else {
+			mACMatches.clear();
+			for (int i = 0; i < (int)mACCandidates.size(); i++) {
+				const auto& candidate = mACCandidates[i];
+				if (line >= candidate.mLineStart && line <= candidate.mLineEnd && matches(candidate))
+					mACMatches.push_back(i);
 			}
 		}
-		for (auto& str : mACUniforms) {
-			std::string lwrStr = str;
-			std::transform(lwrStr.begin(), lwrStr.end(), lwrStr.begin(), tolower);
-
-			size_t loc = lwrStr.find(acWord);
-			if (loc != std::string::npos)
-				weights.push_back(ACEntry(str, str, loc));
-		}
-		for (auto& str : mACGlobals) {
-			std::string lwrStr = str;
-			std::transform(lwrStr.begin(), lwrStr.end(), lwrStr.begin(), tolower);
-
-			size_t loc = lwrStr.find(acWord);
-			if (loc != std::string::npos)
-				weights.push_back(ACEntry(str, str, loc));
-		}
-		for (auto& str : mACUserTypes) {
-			std::string lwrStr = str;
-			std::transform(lwrStr.begin(), lwrStr.end(), lwrStr.begin(), tolower);
-
-			size_t loc = lwrStr.find(acWord);
-			if (loc != std::string::npos)
-				weights.push_back(ACEntry(str, str, loc));
-		}
-		for (auto& str : mLanguageDefinition.mKeywords) {
-			std::string lwrStr = str;
-			std::transform(lwrStr.begin(), lwrStr.end(), lwrStr.begin(), tolower);
-
-			size_t loc = lwrStr.find(acWord);
-			if (loc != std::string::npos)
-				weights.push_back(ACEntry(str, str, loc));
-		}
-		for (auto& str : mLanguageDefinition.mIdentifiers) {
-			std::string lwrStr = str.first;
-			std::transform(lwrStr.begin(), lwrStr.end(), lwrStr.begin(), tolower);
-
-			size_t loc = lwrStr.find(acWord);
-			if (loc != std::string::npos) {
-				std::string val = str.first;
-				if (mCompleteBraces) val += "()";
-				weights.push_back(ACEntry(str.first, val, loc));
+		mACMatchWord = acWord;
+		mACMatchLine = line;
+
+		// the ones that start with the word go first, a word of the document isn't suggested for itself
+		for (int pass = 0; pass < 2; pass++)
+			for (int index : mACMatches) {
+				const auto& candidate = mACCandidates[index];
+				if ((candidate.mKey.compare(0, acWord.size(), acWord) == 0) != (pass == 0))
+					continue;
+				if (candidate.mCount == 1 && candidate.mDisplay == mACWord)
+					continue;
+				mACSuggestions.push_back(std::make_pair(candidate.mDisplay, candidate.mValue));
 			}
-		}
-		
-		// build the actual list
-		for (const auto& entry : weights)
-			if (entry.Location == 0)
-				mACSuggestions.push_back(std::make_pair(entry.DisplayString, entry.Value));
-		for (const auto& entry : weights)
-			if (entry.Location != 0)
-				mACSuggestions.push_back(std::make_pair(entry.DisplayString, entry.Value));
-
 
 		if (mACSuggestions.size() > 0) {
 			mACOpened = true;
@@ -2145,6 +3467,17 @@ void TextEditor::Render(const char* aTitle, const ImVec2& aSize, bool aBorder)
 		HandleMouseInputs();
 
 	ColorizeInternal();
+	if (mFindOpened && mFindWord[0] != '\0')
+		UpdateFindIndex(GetFindMatcher(), std::chrono::steady_clock::now() + std::chrono::microseconds((int64_t)(mIndexTimeBudget * 1000.0f)));
+	else
+		ClearFindIndex();
+	if (mDocumentSymbolsEnabled)
+		UpdateSymbolIndex(std::chrono::steady_clock::now() + std::chrono::microseconds((int64_t)(mIndexTimeBudget * 1000.0f)));
+	else
+		ClearSymbolIndex();
+	UpdateBracketIndex();
+	if (mHighlightBrackets)
+		UpdateBracketHighlight();
 	m_readyForAutocomplete = true;
 	RenderInternal(aTitle);
 
@@ -2161,9 +3494,17 @@ void TextEditor::Render(const char* aTitle, const ImVec2& aSize, bool aBorder)
 				drawList->AddLine(ImVec2(scrollBarRect.Min.x, lineStartY), ImVec2(scrollBarRect.Max.x, lineStartY), (mPalette[(int)PaletteIndex::Default] & 0x00FFFFFFu) | 0x83000000u, 3);
 			}
 
-			for (auto& error : mErrorMarkers) {
-				float lineStartY = std::round(scrollBarRect.Min.y + (float(error.first) - 0.5f) / mLines.size() * scrollBarRect.GetHeight());
-				drawList->AddRectFilled(ImVec2(scrollBarRect.Min.x, lineStartY), ImVec2(scrollBarRect.Min.x + scrollBarRect.GetWidth() * 0.4f, lineStartY + 6.0f), mPalette[(int)PaletteIndex::ErrorMarker]);
+			RenderScrollbarMarkers(drawList, scrollBarRect.Min, scrollBarRect.Max);
+
+			// one marker per few pixels, jumping over the matches that would be drawn on top of it
+			if (mFindIndexMatcher != nullptr && mFindMatchCount > 0) {
+				int linesPerMarker = std::max(1, (int)(mLines.size() * 3.0f / scrollBarRect.GetHeight()));
+				for (int match = 0; match < mFindMatchCount; ) {
+					int line = GetFindMatchLine(match);
+					float lineStartY = std::round(scrollBarRect.Min.y + (float(line) + 0.5f) / mLines.size() * scrollBarRect.GetHeight());
+					drawList->AddRectFilled(ImVec2(scrollBarRect.Max.x - scrollBarRect.GetWidth() * 0.4f, lineStartY), ImVec2(scrollBarRect.Max.x, lineStartY + 2.0f), mPalette[(int)PaletteIndex::Selection] | 0xFF000000u);
+					match = GetFindMatchesBefore(line + linesPerMarker);
+				}
 			}
 			ImGui::PopClipRect();
 		}
@@ -2212,7 +3553,7 @@ void TextEditor::Render(const char* aTitle, const ImVec2& aSize, bool aBorder)
 		ImGui::PopFont();
 
 		ImGui::SetNextWindowPos(ImVec2(mFindOrigin.x + windowWidth - mUICalculateSize(250), mFindOrigin.y + mUICalculateSize(50) * IsDebugging()), ImGuiCond_Always);
-		ImGui::BeginChild(("##ted_findwnd" + std::string(aTitle)).c_str(), ImVec2(mUICalculateSize(220), mUICalculateSize(mReplaceOpened ? 90 : 40)), true, ImGuiWindowFlags_NoScrollbar);
+		ImGui::BeginChild(("##ted_findwnd" + std::string(aTitle)).c_str(), ImVec2(mUICalculateSize(220), mUICalculateSize(mReplaceOpened ? 115 : 65)), true, ImGuiWindowFlags_NoScrollbar);
 
 		// check for findnext shortcut here...
 		ShortcutID curActionID = ShortcutID::Count;
@@ -2238,6 +3579,7 @@ void TextEditor::Render(const char* aTitle, const ImVec2& aSize, bool aBorder)
 			}
 		}
 		mFindNext = curActionID == TextEditor::ShortcutID::FindNext;
+		bool findPrevious = curActionID == TextEditor::ShortcutID::FindPrevious;
 
 		if (mFindJustOpened) {
 			std::string txt = GetSelectedText();
@@ -2246,48 +3588,52 @@ void TextEditor::Render(const char* aTitle, const ImVec2& aSize, bool aBorder)
 		}
 
 		ImGui::PushItemWidth(mUICalculateSize(-45));
-		if (ImGui::InputText(("##ted_findtextbox" + std::string(aTitle)).c_str(), mFindWord, 256, ImGuiInputTextFlags_EnterReturnsTrue) || mFindNext) {
-			auto curPos = mState.mCursorPosition;
-			size_t cindex = 0;
-			for (size_t ln = 0; ln < curPos.mLine; ln++)
-				cindex += GetLineCharacterCount(ln) + 1;
-			cindex += curPos.mColumn;
-
-			std::string textSrc = GetText();
-			size_t textLoc = textSrc.find(mFindWord, cindex);
-			if (textLoc == std::string::npos)
-				textLoc = textSrc.find(mFindWord, 0);
-
-
-			if (textLoc != std::string::npos) {
-				curPos.mLine = curPos.mColumn = 0;
-				cindex = 0;
-				for (size_t ln = 0; ln < mLines.size(); ln++) {
-					int charCount = GetLineCharacterCount(ln) + 1;
-					if (cindex + charCount > textLoc) {
-						curPos.mLine = ln;
-						curPos.mColumn = textLoc - cindex;
-
-						auto& line = mLines[curPos.mLine];
-						for (int i = 0; i < line.size(); i++)
-							if (line[i].mChar == '\t')
-								curPos.mColumn += (mTabSize - 1);
+		bool findEntered = ImGui::InputText(("##ted_findtextbox" + std::string(aTitle)).c_str(), mFindWord, 256, ImGuiInputTextFlags_EnterReturnsTrue);
+
+		// number of matches, and which one is selected
+		if (mFindWord[0] != '\0' && mFindIndexMatcher != nullptr && mFindIndexMatcher == GetFindMatcher()) {
+			char countText[32];
+			int selected = -1;
+			if (IsFindIndexComplete() && mState.mSelectionStart.mLine < (int)mFindMatches.size()) {
+				int start = GetCharacterIndex(mState.mSelectionStart), end = GetCharacterIndex(mState.mSelectionEnd);
+				const auto& matches = mFindMatches[mState.mSelectionStart.mLine];
+				for (size_t i = 0; i < matches.size() && selected == -1; i++)
+					if (matches[i].mStart == start && matches[i].mEnd == end && mState.mSelectionStart.mLine == mState.mSelectionEnd.mLine)
+						selected = GetFindMatchesBefore(mState.mSelectionStart.mLine) + (int)i;
+			}
+			if (!mFindIndexMatcher->IsValid())
+				snprintf(countText, sizeof(countText), "error");
+			else if (!IsFindIndexComplete())
+				snprintf(countText, sizeof(countText), "%d...", mFindMatchCount);
+			else if (selected != -1)
+				snprintf(countText, sizeof(countText), "%d/%d", selected + 1, mFindMatchCount);
+			else
+				snprintf(countText, sizeof(countText), "%d", mFindMatchCount);
 
-						break;
-					}
-					else {// just keep adding
-						cindex += charCount;
-					}
-				}
+			ImVec2 textSize = ImGui::CalcTextSize(countText);
+			ImVec2 textPos(ImGui::GetItemRectMax().x - textSize.x - ImGui::GetStyle().FramePadding.x, ImGui::GetItemRectMin().y + ImGui::GetStyle().FramePadding.y);
+			ImGui::GetWindowDrawList()->AddText(textPos, ImGui::GetColorU32(ImGuiCol_TextDisabled), countText);
+		}
 
+		if (findEntered || mFindNext || findPrevious) {
+			std::shared_ptr<const TextMatcher> matcher = GetFindMatcher();
+			Coordinates selStart, selEnd;
+			bool found;
+			if (findPrevious) {
+				// going backwards needs every match before the cursor, the index is finished first
+				CompleteFindIndex(matcher);
+				found = FindIndexed(mState.mSelectionStart, true, selStart, selEnd);
+			} else if (mFindIndexMatcher == matcher && IsFindIndexComplete())
+				found = FindIndexed(mState.mCursorPosition, false, selStart, selEnd);
+			else
+				found = FindText(*matcher, mState.mCursorPosition, selStart, selEnd); // doesn't wait for the search thread
 
-				auto selStart = curPos, selEnd = curPos;
-				selEnd.mColumn += strlen(mFindWord);
-				SetSelection(curPos, selEnd);
+			if (found) {
+				SetSelection(selStart, selEnd);
 				SetCursorPosition(selEnd);
 				mScrollToCursor = true;
 
-				if (!mFindNext)
+				if (findEntered)
 					ImGui::SetKeyboardFocusHere(0);
 			}
 
@@ -2327,102 +3673,43 @@ void TextEditor::Render(const char* aTitle, const ImVec2& aSize, bool aBorder)
 
 			ImGui::SameLine();
 			if (ImGui::Button((">##replaceOne" + std::string(aTitle)).c_str()) || shouldReplace) {
-				if (strlen(mFindWord) > 0) {
-					auto curPos = mState.mCursorPosition;
-					
-					std::string textSrc = GetText();
-					if (mReplaceIndex >= textSrc.size())
-						mReplaceIndex = 0;
-					size_t textLoc = textSrc.find(mFindWord, mReplaceIndex);
-					if (textLoc == std::string::npos) {
-						mReplaceIndex = 0;
-						textLoc = textSrc.find(mFindWord, 0);
-					}
+				Coordinates selStart, selEnd;
+				if (FindText(*GetFindMatcher(), mReplacePosition, selStart, selEnd)) {
+					SetSelection(selStart, selEnd);
+					ReplaceSelection(mReplaceWord);
+					mScrollToCursor = true;
 
+					ImGui::SetKeyboardFocusHere(0);
 
-					if (textLoc != std::string::npos) {
-						curPos.mLine = curPos.mColumn = 0;
-						int totalCount = 0;
-						for (size_t ln = 0; ln < mLines.size(); ln++) {
-							int lineCharCount = GetLineCharacterCount(ln) + 1;
-							if (textLoc >= totalCount && textLoc < totalCount + lineCharCount) {
-								curPos.mLine = ln;
-								curPos.mColumn = textLoc - totalCount;
-
-								auto& line = mLines[curPos.mLine];
-								for (int i = 0; i < line.size(); i++)
-									if (line[i].mChar == '\t')
-										curPos.mColumn += (mTabSize - 1);
-
-								break;
-							}
-							totalCount += lineCharCount;
-						}
-
-						auto selStart = curPos, selEnd = curPos;
-						selEnd.mColumn += strlen(mFindWord);
-						SetSelection(curPos, selEnd);
-						DeleteSelection();
-						InsertText(mReplaceWord);
-						SetCursorPosition(selEnd);
-						mScrollToCursor = true;
-
-						ImGui::SetKeyboardFocusHere(0);
-
-						mReplaceIndex = textLoc + strlen(mReplaceWord);
-					}
+					// continue after the inserted text
+					mReplacePosition = GetActualCursorCoordinates();
 				}
 			}
 
 			ImGui::SameLine();
 			if (ImGui::Button((">>##replaceAll" + std::string(aTitle)).c_str())) {
-				if (strlen(mFindWord) > 0) {
-					auto curPos = mState.mCursorPosition;
-
-					std::string textSrc = GetText();
-					size_t textLoc = textSrc.find(mFindWord, 0);
-
-					do {
-						if (textLoc != std::string::npos) {
-							curPos.mLine = curPos.mColumn = 0;
-							int totalCount = 0;
-							for (size_t ln = 0; ln < mLines.size(); ln++) {
-								int lineCharCount = GetLineCharacterCount(ln) + 1;
-								if (textLoc >= totalCount && textLoc < totalCount + lineCharCount) {
-									curPos.mLine = ln;
-									curPos.mColumn = textLoc - totalCount;
-
-									auto& line = mLines[curPos.mLine];
-									for (int i = 0; i < line.size(); i++)
-										if (line[i].mChar == '\t')
-											curPos.mColumn += (mTabSize - 1);
-
-									break;
-								}
-								totalCount += lineCharCount;
-							}
-
-
-							auto selStart = curPos, selEnd = curPos;
-							selEnd.mColumn += strlen(mFindWord);
-							SetSelection(curPos, selEnd);
-							DeleteSelection();
-							InsertText(mReplaceWord);
-							SetCursorPosition(selEnd);
-							mScrollToCursor = true;
-
-							ImGui::SetKeyboardFocusHere(0);
-
-							// find next occurance
-							textSrc = GetText();
-							textLoc += strlen(mReplaceWord);
-							textLoc = textSrc.find(mFindWord, textLoc);
-						}
-					} while (textLoc != std::string::npos);
+				if (ReplaceAll(*GetFindMatcher(), mReplaceWord) > 0) {
+					mScrollToCursor = true;
+					ImGui::SetKeyboardFocusHere(0);
 				}
 			}
 		}
 
+		// search options, "Aa" is lit while the case has to match
+		const char* optionLabels[] = { "Aa", "W", ".*" };
+		const int optionFlags[] = { TextMatcher::FlagIgnoreCase, TextMatcher::FlagWholeWord, TextMatcher::FlagRegex };
+		for (int i = 0; i < 3; i++) {
+			bool lit = ((mFindFlags & optionFlags[i]) != 0) != (i == 0);
+			if (lit)
+				ImGui::PushStyleColor(ImGuiCol_Button, ImGui::GetStyleColorVec4(ImGuiCol_ButtonActive));
+			if (ImGui::Button((std::string(optionLabels[i]) + "##findOption" + std::string(aTitle)).c_str()))
+				mFindFlags ^= optionFlags[i];
+			if (lit)
+				ImGui::PopStyleColor();
+			ImGui::SameLine();
+		}
+		ImGui::NewLine();
+
 		ImGui::EndChild();
 
 		ImGui::PushFont(font);
@@ -2536,8 +3823,12 @@ void TextEditor::Render(const char* aTitle, const ImVec2& aSize, bool aBorder)
 
 void TextEditor::SetText(const std::string & aText)
 {
+	Coordinates oldEnd = mLines.empty() ? Coordinates() : Coordinates((int)mLines.size() - 1, GetLineMaxColumn((int)mLines.size() - 1));
+
 	mLines.clear();
-	mLines.emplace_back(Line());
+	mLineArena->Reset();
+
+	mLines.emplace_back(CreateLine());
 	for (auto chr : aText)
 	{
 		if (chr == '\r')
@@ -2545,7 +3836,7 @@ void TextEditor::SetText(const std::string & aText)
 			// ignore the carriage return character
 		}
 		else if (chr == '\n')
-			mLines.emplace_back(Line());
+			mLines.emplace_back(CreateLine());
 		else
 		{
 			mLines.back().emplace_back(Glyph(chr, PaletteIndex::Default));
@@ -2556,22 +3847,28 @@ void TextEditor::SetText(const std::string & aText)
 	mScrollToTop = true;
 
 	mUndoBuffer.clear();
+	mUndoText.clear();
 	mUndoIndex = 0;
 
+	NotifyTextChange(Coordinates(), oldEnd, Coordinates((int)mLines.size() - 1, GetLineMaxColumn((int)mLines.size() - 1)), false); // breakpoints and error markers keep their lines
+
 	Colorize();
 }
 
 void TextEditor::SetTextLines(const std::vector<std::string> & aLines)
 {
+	Coordinates oldEnd = mLines.empty() ? Coordinates() : Coordinates((int)mLines.size() - 1, GetLineMaxColumn((int)mLines.size() - 1));
+
 	mLines.clear();
+	mLineArena->Reset();
 
 	if (aLines.empty())
 	{
-		mLines.emplace_back(Line());
+		mLines.emplace_back(CreateLine());
 	}
 	else
 	{
-		mLines.resize(aLines.size());
+		mLines.resize(aLines.size(), CreateLine());
 
 		for (size_t i = 0; i < aLines.size(); ++i)
 		{
@@ -2587,8 +3884,11 @@ void TextEditor::SetTextLines(const std::vector<std::string> & aLines)
 	mScrollToTop = true;
 
 	mUndoBuffer.clear();
+	mUndoText.clear();
 	mUndoIndex = 0;
 
+	NotifyTextChange(Coordinates(), oldEnd, Coordinates((int)mLines.size() - 1, GetLineMaxColumn((int)mLines.size() - 1)), false); // breakpoints and error markers keep their lines
+
 	Colorize();
 }
 
@@ -2600,6 +3900,9 @@ void TextEditor::EnterCharacter(ImWchar aChar, bool aShift)
 
 	u.mBefore = mState;
 
+	// brace completion is undone together with the character
+	BeginEdit();
+
 	if (HasSelection())
 	{
 		if (aChar == '\t' && mState.mSelectionStart.mLine != mState.mSelectionEnd.mLine)
@@ -2662,6 +3965,7 @@ void TextEditor::EnterCharacter(ImWchar aChar, bool aShift)
 
 			if (modified)
 			{
+				InvalidateLineLayouts(start.mLine, end.mLine + 1);
 				start = Coordinates(start.mLine, GetCharacterColumn(start.mLine, 0));
 				Coordinates rangeEnd;
 				if (originalEnd.mColumn != 0)
@@ -2685,13 +3989,13 @@ void TextEditor::EnterCharacter(ImWchar aChar, bool aShift)
 				mState.mSelectionEnd = end;
 				AddUndo(u);
 
-				mTextChanged = true;
-				if (OnContentUpdate != nullptr)
-					OnContentUpdate(this);
+				NotifyTextChange(u.mRemovedStart, u.mRemovedEnd, u.mAddedEnd);
+				NotifyContentUpdate();
 
 				EnsureCursorVisible();
 			}
 
+			EndEdit();
 			return;
 		}
 		else
@@ -2704,10 +4008,11 @@ void TextEditor::EnterCharacter(ImWchar aChar, bool aShift)
 	}
 
 	auto coord = GetActualCursorCoordinates();
+	auto removedEnd = coord;
 	u.mAddedStart = coord;
 
 	if (mLines.empty())
-		mLines.push_back(Line());
+		mLines.push_back(CreateLine());
 
 	if (aChar == '\n')
 	{
@@ -2715,7 +4020,7 @@ void TextEditor::EnterCharacter(ImWchar aChar, bool aShift)
 		auto& line = mLines[coord.mLine];
 		auto& newLine = mLines[coord.mLine + 1];
 
-		if (mLanguageDefinition.mAutoIndentation && mSmartIndent)
+		if (mLanguageDefinition->mAutoIndentation && mSmartIndent)
 			for (size_t it = 0; it < line.size() && isascii(line[it].mChar) && isblank(line[it].mChar); ++it)
 				newLine.push_back(line[it]);
 
@@ -2723,6 +4028,8 @@ void TextEditor::EnterCharacter(ImWchar aChar, bool aShift)
 		auto cindex = GetCharacterIndex(coord);
 		newLine.insert(newLine.end(), line.begin() + cindex, line.end());
 		line.erase(line.begin() + cindex, line.begin() + line.size());
+		// the lines below moved down, so their layouts no longer line up
+		InvalidateLineLayouts(coord.mLine, std::numeric_limits<int>::max());
 		SetCursorPosition(Coordinates(coord.mLine + 1, GetCharacterColumn(coord.mLine + 1, (int)whitespaceSize)));
 		u.mAdded = (char)aChar;
 	}
@@ -2748,6 +4055,7 @@ void TextEditor::EnterCharacter(ImWchar aChar, bool aShift)
 
 				u.mRemovedStart = mState.mCursorPosition;
 				u.mRemovedEnd = Coordinates(coord.mLine, GetCharacterColumn(coord.mLine, cindex + d));
+				removedEnd = u.mRemovedEnd;
 
 				while (d-- > 0 && cindex < (int)line.size())
 				{
@@ -2758,12 +4066,15 @@ void TextEditor::EnterCharacter(ImWchar aChar, bool aShift)
 
 			for (auto p = buf; *p != '\0'; p++, ++cindex)
 				line.insert(line.begin() + cindex, Glyph(*p, PaletteIndex::Default));
+			InvalidateLineLayouts(coord.mLine, coord.mLine + 1);
 			u.mAdded = buf;
 
 			SetCursorPosition(Coordinates(coord.mLine, GetCharacterColumn(coord.mLine, cindex)));
 		}
-		else
+		else {
+			EndEdit();
 			return;
+		}
 	}
 		
 	// active suggestions
@@ -2772,11 +4083,10 @@ void TextEditor::EnterCharacter(ImWchar aChar, bool aShift)
 		m_readyForAutocomplete = false;
 	}
 
-	mTextChanged = true;
-	if (OnContentUpdate != nullptr)
-		OnContentUpdate(this);
-
 	u.mAddedEnd = GetActualCursorCoordinates();
+	NotifyTextChange(coord, removedEnd, u.mAddedEnd);
+	NotifyContentUpdate();
+
 	u.mAfter = mState;
 
 	AddUndo(u);
@@ -2797,6 +4107,8 @@ void TextEditor::EnterCharacter(ImWchar aChar, bool aShift)
 		if (aChar == '{' || aChar == '(' || aChar == '[')
 			mState.mCursorPosition.mColumn--;
 	}
+
+	EndEdit();
 }
 
 void TextEditor::SetReadOnly(bool aValue)
@@ -2870,11 +4182,7 @@ void TextEditor::SetSelection(const Coordinates & aStart, const Coordinates & aE
 		mState.mSelectionEnd != oldSelEnd)
 		mCursorPositionChanged = true;
 
-	// update mReplaceIndex
-	mReplaceIndex = 0;
-	for (size_t ln = 0; ln < mState.mCursorPosition.mLine; ln++)
-		mReplaceIndex += GetLineCharacterCount(ln) + 1;
-	mReplaceIndex += mState.mCursorPosition.mColumn;
+	mReplacePosition = mState.mCursorPosition;
 }
 
 void TextEditor::InsertText(const std::string& aValue, bool indent)
@@ -3229,9 +4537,8 @@ void TextEditor::Delete()
 				line.erase(line.begin() + cindex);
 		}
 
-		mTextChanged = true;
-		if (OnContentUpdate != nullptr)
-			OnContentUpdate(this);
+		NotifyTextChange(u.mRemovedStart, u.mRemovedEnd, u.mRemovedStart);
+		NotifyContentUpdate();
 
 		Colorize(pos.mLine, 1);
 	}
@@ -3250,6 +4557,9 @@ void TextEditor::Backspace()
 	UndoRecord u;
 	u.mBefore = mState;
 
+	// a completed brace pair is removed as one step
+	BeginEdit();
+
 	if (HasSelection())
 	{
 		u.mRemoved = GetSelectedText();
@@ -3265,8 +4575,10 @@ void TextEditor::Backspace()
 
 		if (mState.mCursorPosition.mColumn == 0)
 		{
-			if (mState.mCursorPosition.mLine == 0)
+			if (mState.mCursorPosition.mLine == 0) {
+				EndEdit();
 				return;
+			}
 
 			u.mRemoved = '\n';
 			u.mRemovedStart = u.mRemovedEnd = Coordinates(pos.mLine - 1, GetLineMaxColumn(pos.mLine - 1));
@@ -3277,11 +4589,6 @@ void TextEditor::Backspace()
 			auto prevSize = GetLineMaxColumn(mState.mCursorPosition.mLine - 1);
 			prevLine.insert(prevLine.end(), line.begin(), line.end());
 
-			ErrorMarkers etmp;
-			for (auto& i : mErrorMarkers)
-				etmp.insert(ErrorMarkers::value_type(i.first - 1 == mState.mCursorPosition.mLine ? i.first - 1 : i.first, i.second));
-			mErrorMarkers = std::move(etmp);
-
 			RemoveLine(mState.mCursorPosition.mLine);
 			--mState.mCursorPosition.mLine;
 			mState.mCursorPosition.mColumn = prevSize;
@@ -3324,9 +4631,8 @@ void TextEditor::Backspace()
 			}
 		}
 
-		mTextChanged = true;
-		if (OnContentUpdate != nullptr)
-			OnContentUpdate(this);
+		NotifyTextChange(u.mRemovedStart, u.mRemovedEnd, u.mRemovedStart);
+		NotifyContentUpdate();
 
 		EnsureCursorVisible();
 		Colorize(mState.mCursorPosition.mLine, 1);
@@ -3334,6 +4640,7 @@ void TextEditor::Backspace()
 
 	u.mAfter = mState;
 	AddUndo(u);
+	EndEdit();
 
 	// autocomplete
 	if (mActiveAutocomplete && mACOpened) {
@@ -3405,10 +4712,12 @@ void TextEditor::Cut()
 			u.mRemovedEnd = mState.mSelectionEnd;
 
 			Copy();
+			BeginEdit();
 			DeleteSelection();
 
 			u.mAfter = mState;
 			AddUndo(u);
+			EndEdit();
 		}
 	}
 }
@@ -3420,27 +4729,35 @@ void TextEditor::Paste()
 
 	auto clipText = ImGui::GetClipboardText();
 	if (clipText != nullptr && strlen(clipText) > 0)
-	{
-		UndoRecord u;
-		u.mBefore = mState;
+		ReplaceSelection(clipText, mAutoindentOnPaste);
+}
 
-		if (HasSelection())
-		{
-			u.mRemoved = GetSelectedText();
-			u.mRemovedStart = mState.mSelectionStart;
-			u.mRemovedEnd = mState.mSelectionEnd;
-			DeleteSelection();
-		}
+void TextEditor::ReplaceSelection(const char* aValue, bool aIndent)
+{
+	UndoRecord u;
+	u.mBefore = mState;
+
+	BeginEdit();
+
+	if (HasSelection())
+	{
+		u.mRemoved = GetSelectedText();
+		u.mRemovedStart = mState.mSelectionStart;
+		u.mRemovedEnd = mState.mSelectionEnd;
+		DeleteSelection();
+	}
 
-		u.mAdded = clipText;
-		u.mAddedStart = GetActualCursorCoordinates();
+	u.mAddedStart = GetActualCursorCoordinates();
 
-		InsertText(clipText, mAutoindentOnPaste);
+	InsertText(aValue, aIndent);
 
-		u.mAddedEnd = GetActualCursorCoordinates();
-		u.mAfter = mState;
+	u.mAddedEnd = GetActualCursorCoordinates();
+	u.mAdded = aIndent ? GetText(u.mAddedStart, u.mAddedEnd) : aValue; // auto indent can add whitespace
+	u.mAfter = mState;
+	if (!u.mAdded.empty() || !u.mRemoved.empty())
 		AddUndo(u);
-	}
+
+	EndEdit();
 }
 
 bool TextEditor::CanUndo()
@@ -3455,14 +4772,26 @@ bool TextEditor::CanRedo()
 
 void TextEditor::Undo(int aSteps)
 {
-	while (CanUndo() && aSteps-- > 0)
-		mUndoBuffer[--mUndoIndex].Undo(this);
+	BeginEdit();
+	while (CanUndo() && aSteps-- > 0) {
+		bool grouped;
+		do {
+			grouped = mUndoBuffer[--mUndoIndex].mGrouped;
+			GetUndoRecord(mUndoIndex).Undo(this);
+		} while (grouped && mUndoIndex > 0);
+	}
+	EndEdit();
 }
 
 void TextEditor::Redo(int aSteps)
 {
-	while (CanRedo() && aSteps-- > 0)
-		mUndoBuffer[mUndoIndex++].Redo(this);
+	BeginEdit();
+	while (CanRedo() && aSteps-- > 0) {
+		do
+			GetUndoRecord(mUndoIndex++).Redo(this);
+		while (mUndoIndex < (int)mUndoBuffer.size() && mUndoBuffer[mUndoIndex].mGrouped);
+	}
+	EndEdit();
 }
 
 const TextEditor::Palette & TextEditor::GetDarkPalette()
@@ -3624,11 +4953,9 @@ void TextEditor::ProcessInputs()
 void TextEditor::Colorize(int aFromLine, int aLines)
 {
 	int toLine = aLines == -1 ? (int)mLines.size() : std::min<int>((int)mLines.size(), aFromLine + aLines);
-	mColorRangeMin = std::min<int>(mColorRangeMin, aFromLine);
-	mColorRangeMax = std::max<int>(mColorRangeMax, toLine);
-	mColorRangeMin = std::max<int>(0, mColorRangeMin);
-	mColorRangeMax = std::max<int>(mColorRangeMin, mColorRangeMax);
-	mCheckComments = true;
+	AddColorRange(std::max(0, aFromLine), toLine);
+	mCommentRangeMin = std::max<int>(0, std::min<int>(mCommentRangeMin, aFromLine));
+	mCommentRangeMax = std::max<int>(mCommentRangeMax, toLine);
 }
 
 void TextEditor::ColorizeRange(int aFromLine, int aToLine)
@@ -3636,9 +4963,10 @@ void TextEditor::ColorizeRange(int aFromLine, int aToLine)
 	if (mLines.empty() || !mColorizerEnabled)
 		return;
 
+	auto symbols = GetColorizerSymbols();
 	std::string buffer;
-	std::cmatch results;
-	std::string id;
+	std::vector<uint8_t> preprocessor;
+	std::vector<PaletteIndex> colors;
 
 	int endLine = std::max(0, std::min((int)mLines.size(), aToLine));
 	for (int i = aFromLine; i < endLine; ++i)
@@ -3649,329 +4977,2008 @@ void TextEditor::ColorizeRange(int aFromLine, int aToLine)
 			continue;
 
 		buffer.resize(line.size());
+		preprocessor.resize(line.size());
+		colors.resize(line.size());
 		for (size_t j = 0; j < line.size(); ++j)
 		{
-			auto& col = line[j];
-			buffer[j] = col.mChar;
-			col.mColorIndex = PaletteIndex::Default;
+			buffer[j] = line[j].mChar;
+			preprocessor[j] = line[j].mPreprocessor;
 		}
 
-		const char* bufferBegin = &buffer.front();
-		const char* bufferEnd = bufferBegin + buffer.size();
+		ColorizeLine(*mColorizerLanguage, *symbols, i, buffer.data(), buffer.data() + buffer.size(), preprocessor.data(), colors.data());
+
+		for (size_t j = 0; j < line.size(); ++j)
+			line[j].mColorIndex = colors[j];
+	}
+	InvalidateLineLayouts(aFromLine, endLine);
+}
+
+void TextEditor::ColorizeLine(const ColorizerLanguage& aLanguage, const ColorizerSymbols& aSymbols, int aLine, const char* aBegin, const char* aEnd, const uint8_t* aPreprocessor, PaletteIndex* aOutColors)
+{
+	std::cmatch results;
+
+	std::fill(aOutColors, aOutColors + (aEnd - aBegin), PaletteIndex::Default);
+
+	const char* bufferBegin = aBegin;
+	auto last = aEnd;
+
+	for (auto first = bufferBegin; first != last; )
+	{
+		const char* token_begin = nullptr;
+		const char* token_end = nullptr;
+		PaletteIndex token_color = PaletteIndex::Default;
 
-		auto last = bufferEnd;
+		bool hasTokenizeResult = false;
 
-		for (auto first = bufferBegin; first != last; )
+		if (aLanguage.mTokenize != nullptr)
 		{
-			const char* token_begin = nullptr;
-			const char* token_end = nullptr;
-			PaletteIndex token_color = PaletteIndex::Default;
+			if (aLanguage.mTokenize(first, last, token_begin, token_end, token_color))
+				hasTokenizeResult = true;
+		}
 
-			bool hasTokenizeResult = false;
+		if (hasTokenizeResult == false && aLanguage.mTokenDFA.IsCompiled())
+		{
+			token_begin = first;
+			hasTokenizeResult = aLanguage.mTokenDFA.Match(first, last, token_end, token_color);
+		}
+		else if (hasTokenizeResult == false)
+		{
+			// todo : remove
+				//printf("using regex for %.*s\n", first + 10 < last ? 10 : int(last - first), first);
 
-			if (mLanguageDefinition.mTokenize != nullptr)
+			for (auto& p : aLanguage.mRegexList)
 			{
-				if (mLanguageDefinition.mTokenize(first, last, token_begin, token_end, token_color))
+				if (std::regex_search(first, last, results, p.first, std::regex_constants::match_continuous))
+				{
 					hasTokenizeResult = true;
+
+					auto& v = *results.begin();
+					token_begin = v.first;
+					token_end = v.second;
+					token_color = p.second;
+					break;
+				}
 			}
+		}
+
+		if (hasTokenizeResult == false)
+		{
+			first++;
+		}
+		else
+		{
+			const size_t token_length = token_end - token_begin;
 
-			if (hasTokenizeResult == false)
+			if (token_color == PaletteIndex::Identifier)
 			{
-				// todo : remove
-					//printf("using regex for %.*s\n", first + 10 < last ? 10 : int(last - first), first);
+				// todo : allmost all language definitions use lower case to specify keywords, so shouldn't this use ::tolower ?
+				uint8_t word = aLanguage.mWords.Find(std::string_view(token_begin, token_length));
 
-				for (auto& p : mRegexList)
+				if (!aPreprocessor[first - bufferBegin])
 				{
-					if (std::regex_search(first, last, results, p.first, std::regex_constants::match_continuous))
-					{
-						hasTokenizeResult = true;
-
-						auto& v = *results.begin();
-						token_begin = v.first;
-						token_end = v.second;
-						token_color = p.second;
-						break;
-					}
+					if (word & WordTable::FlagKeyword)
+						token_color = PaletteIndex::Keyword;
+					else if (word & WordTable::FlagIdentifier)
+						token_color = PaletteIndex::KnownIdentifier;
+					else if (word & WordTable::FlagPreprocIdentifier)
+						token_color = PaletteIndex::PreprocIdentifier;
+					else
+						aSymbols.Find(std::string_view(token_begin, token_length), aLanguage.mCaseSensitive, aLine, token_color);
+				}
+				else
+				{
+					if (word & WordTable::FlagPreprocIdentifier)
+						token_color = PaletteIndex::PreprocIdentifier;
 				}
 			}
 
-			if (hasTokenizeResult == false)
-			{
-				first++;
-			}
-			else
-			{
-				const size_t token_length = token_end - token_begin;
+			for (size_t j = 0; j < token_length; ++j)
+				aOutColors[(token_begin - bufferBegin) + j] = token_color;
 
-				if (token_color == PaletteIndex::Identifier)
-				{
-					id.assign(token_begin, token_end);
+			first = token_end;
+		}
+	}
+}
 
-					// todo : allmost all language definitions use lower case to specify keywords, so shouldn't this use ::tolower ?
-					if (!mLanguageDefinition.mCaseSensitive)
-						std::transform(id.begin(), id.end(), id.begin(), ::toupper);
+void TextEditor::ColorizerSymbols::AddFunction(const std::string& aName, const FunctionData& aData)
+{
+	auto it = mFunctions.find(aName);
+	int id;
+	if (it != mFunctions.end()) {
+		// redeclared, drop the arguments and locals of the old declaration
+		id = it->second.first;
+		for (const auto& arg : it->second.second.Arguments)
+			RemoveScopes(arg, id);
+		for (const auto& loc : it->second.second.Locals)
+			RemoveScopes(loc, id);
+		it->second.second = aData;
+	} else {
+		id = (int)mFunctions.size();
+		mFunctions[aName] = std::make_pair(id, aData);
+	}
 
-					if (!line[first - bufferBegin].mPreprocessor)
-					{
-						if (mLanguageDefinition.mKeywords.count(id) != 0)
-							token_color = PaletteIndex::Keyword;
-						else if (mLanguageDefinition.mIdentifiers.count(id) != 0)
-							token_color = PaletteIndex::KnownIdentifier;
-						else if (mLanguageDefinition.mPreprocIdentifiers.count(id) != 0)
-							token_color = PaletteIndex::PreprocIdentifier;
-						else {
-							bool found = false;
-							
-							// functions, arguments, local variables
-							for (const auto& func : mACFunctions) {
-								if (strcmp(func.first.c_str(), id.c_str()) == 0) {
-									token_color = PaletteIndex::UserFunction;
-									found = true;
-									break;
-								}
+	AddName(aName, PaletteIndex::UserFunction);
+
+	Scope scope;
+	scope.mStart = aData.LineStart - 3;
+	scope.mEnd = aData.LineEnd + 1;
+	scope.mFunction = id;
+	scope.mColor = PaletteIndex::FunctionArgument;
+	for (const auto& arg : aData.Arguments)
+		AddScope(arg, scope);
+	scope.mColor = PaletteIndex::LocalVariable;
+	for (const auto& loc : aData.Locals)
+		AddScope(loc, scope);
+}
 
-								if (i >= func.second.LineStart - 3 && i <= func.second.LineEnd + 1) {
-									for (const auto& arg : func.second.Arguments) {
-										if (strcmp(arg.c_str(), id.c_str()) == 0) {
-											token_color = PaletteIndex::FunctionArgument;
-											found = true;
-											break;
-										}
-									}
-									if (!found) {
-										for (const auto& loc : func.second.Locals) {
-											if (strcmp(loc.c_str(), id.c_str()) == 0) {
-												token_color = PaletteIndex::LocalVariable;
-												found = true;
-												break;
-											}
-										}
-										if (found) break;
-									} else
-										break;
-								}
-							}
+void TextEditor::ColorizerSymbols::AddName(const std::string& aName, PaletteIndex aColor)
+{
+	// a name used for several things gets the color the old linear search would have found first
+	auto rank = [](PaletteIndex aIndex) {
+		switch (aIndex) {
+		case PaletteIndex::UserFunction: return 3;
+		case PaletteIndex::UniformVariable: return 2;
+		case PaletteIndex::GlobalVariable: return 1;
+		default: return 0;
+		}
+	};
 
-							// uniforms
-							if (!found) {
-								for (const auto& unif : mACUniforms) {
-									if (strcmp(unif.c_str(), id.c_str()) == 0) {
-										token_color = PaletteIndex::UniformVariable;
-										found = true;
-										break;
-									}
-								}
-							}
+	auto& symbol = GetSymbol(aName);
+	if (symbol.mColor == PaletteIndex::Default || rank(aColor) > rank(symbol.mColor))
+		symbol.mColor = aColor;
+}
 
-							// globals
-							if (!found) {
-								for (const auto& glob : mACGlobals) {
-									if (strcmp(glob.c_str(), id.c_str()) == 0) {
-										token_color = PaletteIndex::GlobalVariable;
-										found = true;
-										break;
-									}
-								}
-							}
+TextEditor::ColorizerSymbols::Symbols::const_iterator TextEditor::ColorizerSymbols::FindSymbol(std::string_view aName) const
+{
+	auto range = mSymbols.equal_range(std::hash<std::string_view>()(aName));
+	for (auto it = range.first; it != range.second; ++it)
+		if (it->second.mName == aName)
+			return it;
+	return mSymbols.end();
+}
 
-							// user types
-							if (!found) {
-								for (const auto& userType : mACUserTypes) {
-									if (strcmp(userType.c_str(), id.c_str()) == 0) {
-										token_color = PaletteIndex::UserType;
-										found = true;
-										break;
-									}
-								}
-							}
-						}
-					}
-					else
-					{
-						if (mLanguageDefinition.mPreprocIdentifiers.count(id) != 0)
-							token_color = PaletteIndex::PreprocIdentifier;
-					}
-				}
+TextEditor::ColorizerSymbols::Symbols::iterator TextEditor::ColorizerSymbols::FindSymbol(const std::string& aName)
+{
+	auto range = mSymbols.equal_range(std::hash<std::string_view>()(aName));
+	for (auto it = range.first; it != range.second; ++it)
+		if (it->second.mName == aName)
+			return it;
+	return mSymbols.end();
+}
+
+TextEditor::ColorizerSymbols::Symbol& TextEditor::ColorizerSymbols::GetSymbol(const std::string& aName)
+{
+	auto it = FindSymbol(aName);
+	if (it != mSymbols.end())
+		return it->second;
+
+	Symbol symbol;
+	symbol.mName = aName;
+	symbol.mColor = PaletteIndex::Default;
+	return mSymbols.emplace(std::hash<std::string_view>()(aName), std::move(symbol))->second;
+}
+
+void TextEditor::ColorizerSymbols::AddScope(const std::string& aName, const Scope& aScope)
+{
+	auto& scopes = GetSymbol(aName).mScopes;
+	auto at = std::lower_bound(scopes.begin(), scopes.end(), aScope.mStart, [](const Scope& aOther, int aStart) { return aOther.mStart < aStart; });
+	for (; at != scopes.end() && at->mStart == aScope.mStart; ++at)
+		if (at->mFunction == aScope.mFunction)
+			return; // argument and local with the same name, the argument wins
+
+	// documents add their functions in order, so the running maximum usually only needs the new scope
+	size_t index = at - scopes.begin();
+	scopes.insert(at, aScope);
+	int maxEnd = index > 0 ? scopes[index - 1].mMaxEnd : std::numeric_limits<int>::min();
+	for (size_t i = index; i < scopes.size(); i++)
+		scopes[i].mMaxEnd = maxEnd = std::max(maxEnd, scopes[i].mEnd);
+}
+
+void TextEditor::ColorizerSymbols::RemoveScopes(const std::string& aName, int aFunction)
+{
+	auto it = FindSymbol(aName);
+	if (it == mSymbols.end())
+		return;
+
+	auto& scopes = it->second.mScopes;
+	scopes.erase(std::remove_if(scopes.begin(), scopes.end(), [aFunction](const Scope& aScope) { return aScope.mFunction == aFunction; }), scopes.end());
+	if (scopes.empty() && it->second.mColor == PaletteIndex::Default)
+		mSymbols.erase(it);
+	else
+		UpdateMaxEnd(scopes);
+}
+
+void TextEditor::ColorizerSymbols::UpdateMaxEnd(Scopes& aScopes)
+{
+	int maxEnd = std::numeric_limits<int>::min();
+	for (auto& scope : aScopes)
+		scope.mMaxEnd = maxEnd = std::max(maxEnd, scope.mEnd);
+}
+
+bool TextEditor::ColorizerSymbols::Find(std::string_view aName, bool aCaseSensitive, int aLine, PaletteIndex& aOutColor) const
+{
+	// names of case insensitive languages are compared in upper case, the copy stays on the stack
+	char upper[64];
+	std::string longUpper;
+	if (!aCaseSensitive) {
+		char* out = upper;
+		if (aName.size() > sizeof(upper)) {
+			longUpper.resize(aName.size());
+			out = &longUpper[0];
+		}
+		for (size_t i = 0; i < aName.size(); i++)
+			out[i] = (aName[i] >= 'a' && aName[i] <= 'z') ? aName[i] - ('a' - 'A') : aName[i];
+		aName = std::string_view(out, aName.size());
+	}
+
+	auto found = FindSymbol(aName);
+	if (found == mSymbols.end())
+		return false;
+
+	const Symbol& symbol = found->second;
+	if (symbol.mColor == PaletteIndex::UserFunction) {
+		aOutColor = symbol.mColor;
+		return true;
+	}
+
+	// arguments and locals: the last scope starting at or before aLine that still contains it
+	const auto& scopes = symbol.mScopes;
+	auto it = std::upper_bound(scopes.begin(), scopes.end(), aLine, [](int aLine, const Scope& aScope) { return aLine < aScope.mStart; });
+	while (it != scopes.begin()) {
+		--it;
+		if (it->mMaxEnd < aLine)
+			break;
+		if (it->mEnd >= aLine) {
+			aOutColor = it->mColor;
+			return true;
+		}
+	}
+
+	if (symbol.mColor != PaletteIndex::Default) {
+		aOutColor = symbol.mColor;
+		return true;
+	}
+	return false;
+}
+
+std::shared_ptr<const TextEditor::ColorizerSymbols> TextEditor::GetColorizerSymbols()
+{
+	if (mColorizerSymbols == nullptr) {
+		auto symbols = std::make_shared<ColorizerSymbols>();
+
+		// the autocomplete data goes on top of what was found in the text
+		for (const auto& func : mDocumentSymbols.mFunctions)
+			symbols->AddFunction(func.first, func.second);
+		for (const auto& unif : mDocumentSymbols.mUniforms)
+			symbols->AddName(unif, PaletteIndex::UniformVariable);
+		for (const auto& glob : mDocumentSymbols.mGlobals)
+			symbols->AddName(glob, PaletteIndex::GlobalVariable);
+		for (const auto& userType : mDocumentSymbols.mTypes)
+			symbols->AddName(userType, PaletteIndex::UserType);
+
+		for (const auto& func : mACFunctions)
+			symbols->AddFunction(func.first, func.second);
+		for (const auto& unif : mACUniforms)
+			symbols->AddName(unif, PaletteIndex::UniformVariable);
+		for (const auto& glob : mACGlobals)
+			symbols->AddName(glob, PaletteIndex::GlobalVariable);
+		for (const auto& userType : mACUserTypes)
+			symbols->AddName(userType, PaletteIndex::UserType);
+		mColorizerSymbols = symbols;
+	}
+	return mColorizerSymbols;
+}
+
+TextEditor::ColorizerSymbols& TextEditor::EditColorizerSymbols()
+{
+	GetColorizerSymbols();
+
+	// a colorizer job still reads the current table, changes go to a copy
+	if (mColorizerSymbols.use_count() > 1)
+		mColorizerSymbols = std::make_shared<ColorizerSymbols>(*mColorizerSymbols);
+	return *mColorizerSymbols;
+}
+
+void TextEditor::AddColorRange(int aFromLine, int aToLine)
+{
+	if (aFromLine >= aToLine)
+		return;
+
+	// merge with every range it overlaps or touches
+	auto it = std::lower_bound(mColorRanges.begin(), mColorRanges.end(), aFromLine, [](const std::pair<int, int>& aRange, int aLine) { return aRange.second < aLine; });
+	auto last = it;
+	while (last != mColorRanges.end() && last->first <= aToLine) {
+		aFromLine = std::min(aFromLine, last->first);
+		aToLine = std::max(aToLine, last->second);
+		++last;
+	}
+	it = mColorRanges.erase(it, last);
+	mColorRanges.insert(it, std::make_pair(aFromLine, aToLine));
+}
+
+void TextEditor::RemoveColorRange(int aFromLine, int aToLine)
+{
+	std::vector<std::pair<int, int>> ranges;
+	for (const auto& range : mColorRanges) {
+		if (range.first < aFromLine)
+			ranges.push_back(std::make_pair(range.first, std::min(range.second, aFromLine)));
+		if (range.second > aToLine)
+			ranges.push_back(std::make_pair(std::max(range.first, aToLine), range.second));
+	}
+	mColorRanges = std::move(ranges);
+}
+
+void TextEditor::NextColorRange(int aMaxLines, int& aFromLine, int& aToLine) const
+{
+	// visible lines first, then the closest lines above or below the view
+	int bestDistance = std::numeric_limits<int>::max();
+	for (const auto& range : mColorRanges) {
+		if (range.second <= mVisibleLineStart) {
+			int distance = mVisibleLineStart - range.second;
+			if (distance < bestDistance) {
+				bestDistance = distance;
+				aFromLine = std::max(range.first, range.second - aMaxLines);
+				aToLine = range.second;
+			}
+		}
+		else if (range.first >= mVisibleLineEnd) {
+			int distance = range.first - mVisibleLineEnd;
+			if (distance < bestDistance) {
+				bestDistance = distance;
+				aFromLine = range.first;
+				aToLine = std::min(range.second, range.first + aMaxLines);
+			}
+			break;
+		}
+		else {
+			aFromLine = std::max(range.first, mVisibleLineStart);
+			aToLine = std::min(range.second, aFromLine + aMaxLines);
+			return;
+		}
+	}
+}
+
+int TextEditor::SubmitColorizeJob(int aFromLine, int aToLine, size_t aMaxBytes, const std::chrono::steady_clock::time_point& aDeadline)
+{
+	std::unique_ptr<ColorizeJob> job(new ColorizeJob());
+	job->mFromLine = aFromLine;
+	job->mVersion = mVersion;
+	job->mLanguage = mColorizerLanguage;
+	job->mSymbols = GetColorizerSymbols();
+	job->mThreadCount = GetColorizerWorkerCount();
+	job->mSeconds = 0.0;
+
+	// stop copying once the job is big enough or the frame's budget is used up, the rest is picked up later
+	int line = aFromLine;
+	while (line < aToLine && job->mText.size() < aMaxBytes) {
+		for (const auto& glyph : mLines[line]) {
+			job->mText.push_back(glyph.mChar);
+			job->mPreprocessor.push_back(glyph.mPreprocessor);
+		}
+		job->mLineEnds.push_back((int)job->mText.size());
+		line++;
+
+		if ((line - aFromLine) % 256 == 0 && std::chrono::steady_clock::now() > aDeadline)
+			break;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mColorizerMutex);
+		mColorizerJobs.push_back(std::move(job));
+	}
+	if (!mColorizerThread.joinable())
+		mColorizerThread = std::thread(&TextEditor::ColorizerThread, this);
+	mColorizerCondition.notify_one();
+
+	mColorizerLines.emplace_back(aFromLine, line);
+	return line;
+}
+
+void TextEditor::ApplyColorizeJob(const ColorizeJob& aJob)
+{
+	int lineCount = (int)aJob.mLineEnds.size();
+	auto lines = mColorizerLines.front();
+	mColorizerLines.pop_front();
+
+	// the colors are out of date, the lines are colorized again, NotifyTextChange() already
+	// queued them where they are now if the text changed
+	if (aJob.mVersion != mVersion || aJob.mLanguage != mColorizerLanguage || aJob.mSymbols != mColorizerSymbols) {
+		if (lines.first < lines.second)
+			Colorize(lines.first, lines.second - lines.first);
+		return;
+	}
+
+	int start = 0;
+	for (int i = 0; i < lineCount; i++) {
+		auto& line = mLines[aJob.mFromLine + i];
+		for (size_t j = 0; j < line.size(); j++)
+			line[j].mColorIndex = aJob.mColors[start + j];
+		start = aJob.mLineEnds[i];
+	}
+	InvalidateLineLayouts(aJob.mFromLine, aJob.mFromLine + lineCount);
+
+	if (aJob.mSeconds > 0.0)
+		mColorizerLinesPerSecond = lineCount / aJob.mSeconds;
+}
+
+void TextEditor::RunColorizeJob(ColorizeJob& aJob, ColorizerPool& aPool)
+{
+	auto startTime = std::chrono::steady_clock::now();
+
+	const char* text = aJob.mText.data();
+	aJob.mColors.resize(aJob.mText.size());
+
+	// line entry states are already resolved, so every chunk of lines can be tokenized on its own
+	auto colorizeLines = [&aJob, text](int aFrom, int aTo) {
+		int start = aFrom == 0 ? 0 : aJob.mLineEnds[aFrom - 1];
+		for (int i = aFrom; i < aTo; i++) {
+			int end = aJob.mLineEnds[i];
+			ColorizeLine(*aJob.mLanguage, *aJob.mSymbols, aJob.mFromLine + i, text + start, text + end, aJob.mPreprocessor.data() + start, aJob.mColors.data() + start);
+			start = end;
+		}
+	};
+
+	// small jobs aren't worth starting threads for
+	const int minLinesPerThread = 2048;
+	int lineCount = (int)aJob.mLineEnds.size();
+	int threadCount = std::max(1, std::min(aJob.mThreadCount, lineCount / minLinesPerThread));
+
+	aPool.Run(threadCount, [&](int aIndex) {
+		colorizeLines((int)((int64_t)lineCount * aIndex / threadCount), (int)((int64_t)lineCount * (aIndex + 1) / threadCount));
+	});
+
+	aJob.mSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+int TextEditor::GetColorizerWorkerCount() const
+{
+	if (mColorizerThreadCount > 0)
+		return mColorizerThreadCount;
+	return std::max(1, (int)std::thread::hardware_concurrency());
+}
+
+TextEditor::ColorizerPool::~ColorizerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mExit = true;
+	}
+	mStartCondition.notify_all();
+	for (auto& thread : mThreads)
+		thread.join();
+}
+
+void TextEditor::ColorizerPool::Run(int aCount, const std::function<void(int)>& aTask)
+{
+	if (aCount > 1) {
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			while ((int)mThreads.size() < aCount - 1)
+				mThreads.emplace_back(&ColorizerPool::Worker, this, (int)mThreads.size() + 1);
+			mTask = &aTask;
+			mTaskCount = aCount;
+			mPending = aCount - 1;
+			mGeneration++;
+		}
+		mStartCondition.notify_all();
+	}
+
+	aTask(0);
+
+	if (aCount > 1) {
+		std::unique_lock<std::mutex> lock(mMutex);
+		mDoneCondition.wait(lock, [this] { return mPending == 0; });
+		mTask = nullptr;
+	}
+}
+
+void TextEditor::ColorizerPool::Worker(int aIndex)
+{
+	unsigned int generation = 0;
+	std::unique_lock<std::mutex> lock(mMutex);
+	while (true) {
+		mStartCondition.wait(lock, [&] { return mExit || mGeneration != generation; });
+		if (mExit)
+			break;
+
+		// workers beyond the task's count sit this one out
+		generation = mGeneration;
+		if (aIndex >= mTaskCount)
+			continue;
+
+		const std::function<void(int)>& task = *mTask;
+		lock.unlock();
+		task(aIndex);
+		lock.lock();
+
+		if (--mPending == 0)
+			mDoneCondition.notify_one();
+	}
+}
+
+void TextEditor::ColorizerThread()
+{
+	ColorizerPool pool;
+
+	std::unique_lock<std::mutex> lock(mColorizerMutex);
+	while (true) {
+		mColorizerCondition.wait(lock, [this] { return mColorizerExit || !mColorizerJobs.empty(); });
+		if (mColorizerExit)
+			break;
+
+		std::unique_ptr<ColorizeJob> job = std::move(mColorizerJobs.front());
+		mColorizerJobs.pop_front();
+		lock.unlock();
+
+		RunColorizeJob(*job, pool);
+
+		lock.lock();
+		mColorizerResults.push_back(std::move(job));
+	}
+}
+
+uint8_t TextEditor::ScanLineComments(int aLine, uint8_t aState)
+{
+	auto& line = mLines[aLine];
+
+	bool withinBlockComment = (aState & LineStateBlockComment) != 0;
+	bool withinString = (aState & LineStateString) != 0;
+	bool concatenate = (aState & LineStateConcatenate) != 0;
+	bool withinSingleLineComment = (aState & LineStateSingleLineComment) != 0;
+	bool withinPreproc = (aState & LineStatePreprocessor) != 0;
+	bool firstChar = (aState & LineStateFirstChar) != 0;	// there is no other non-whitespace characters in the line before
+	int commentStartIndex = std::numeric_limits<int>::max();	// block comment that starts on this line
+
+	if (!concatenate)
+	{
+		withinSingleLineComment = false;
+		withinPreproc = false;
+		firstChar = true;
+	}
+	concatenate = false;
+
+	int currentIndex = 0;
+	while (currentIndex < (int)line.size())
+	{
+		auto& g = line[currentIndex];
+		auto c = g.mChar;
+
+		concatenate = false;
+
+		if (c != mLanguageDefinition->mPreprocChar && !isspace(c))
+			firstChar = false;
+
+		if (currentIndex == (int)line.size() - 1 && line[line.size() - 1].mChar == '\\')
+			concatenate = true;
+
+		bool inComment = withinBlockComment || commentStartIndex <= currentIndex;
+
+		if (withinString)
+		{
+			line[currentIndex].mMultiLineComment = inComment;
+
+			// "" and escapes skip the next glyph, a '\' at the end of the line continues the string
+			if (c == '\"' && (currentIndex + 1 >= (int)line.size() || line[currentIndex + 1].mChar != '\"'))
+				withinString = false;
+			else if ((c == '\"' || c == '\\') && currentIndex + 1 < (int)line.size())
+			{
+				line[currentIndex].mPreprocessor = withinPreproc;
+				currentIndex += 1;
+				line[currentIndex].mMultiLineComment = inComment;
+			}
+		}
+		else
+		{
+			if (firstChar && c == mLanguageDefinition->mPreprocChar)
+				withinPreproc = true;
+
+			if (c == '\"')
+			{
+				withinString = true;
+				line[currentIndex].mMultiLineComment = inComment;
+			}
+			else
+			{
+				auto pred = [](const char& a, const Glyph& b) { return a == b.mChar; };
+				auto from = line.begin() + currentIndex;
+				auto& startStr = mLanguageDefinition->mCommentStart;
+				auto& singleStartStr = mLanguageDefinition->mSingleLineComment;
+
+				if (singleStartStr.size() > 0 &&
+					currentIndex + singleStartStr.size() <= line.size() &&
+					equals(singleStartStr.begin(), singleStartStr.end(), from, from + singleStartStr.size(), pred))
+				{
+					withinSingleLineComment = true;
+				}
+				else if (!withinSingleLineComment && currentIndex + startStr.size() <= line.size() &&
+					equals(startStr.begin(), startStr.end(), from, from + startStr.size(), pred))
+				{
+					commentStartIndex = currentIndex;
+				}
+
+				inComment = withinBlockComment || commentStartIndex <= currentIndex;
+
+				line[currentIndex].mMultiLineComment = inComment;
+				line[currentIndex].mComment = withinSingleLineComment;
+
+				auto& endStr = mLanguageDefinition->mCommentEnd;
+				if (currentIndex + 1 >= (int)endStr.size() &&
+					equals(endStr.begin(), endStr.end(), from + 1 - endStr.size(), from + 1, pred))
+				{
+					withinBlockComment = false;
+					commentStartIndex = std::numeric_limits<int>::max();
+				}
+			}
+		}
+		if (currentIndex < (int)line.size())
+			line[currentIndex].mPreprocessor = withinPreproc;
+		currentIndex += UTF8CharLength(c);
+	}
+
+	uint8_t state = 0;
+	if (withinBlockComment || commentStartIndex != std::numeric_limits<int>::max())
+		state |= LineStateBlockComment;
+	if (withinString)
+		state |= LineStateString;
+	if (concatenate) {
+		state |= LineStateConcatenate;
+		if (withinSingleLineComment)
+			state |= LineStateSingleLineComment;
+		if (withinPreproc)
+			state |= LineStatePreprocessor;
+		if (firstChar)
+			state |= LineStateFirstChar;
+	}
+	else
+		state |= LineStateFirstChar;
+	return state;
+}
+
+void TextEditor::ColorizeInternal()
+{
+	if (mLines.empty() || !mColorizerEnabled || mEditDepth > 0)
+		return;
+
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds((int64_t)(mColorizerTimeBudget * 1000.0f));
+
+	// block comments, strings and line continuations, from the first changed line until
+	// a line starts in the same state as before
+	if (mCommentRangeMin < mCommentRangeMax)
+	{
+		const int lineCount = (int)mLines.size();
+		if (mLineStates.size() != mLines.size()) {
+			mLineStates.assign(mLines.size(), LineStateInvalid);
+			mCommentRangeMin = 0;
+		}
+
+		int currentLine = std::min(mCommentRangeMin, lineCount - 1);
+		while (currentLine > 0 && mLineStates[currentLine] == LineStateInvalid)
+			currentLine--;
+
+		uint8_t state = currentLine == 0 ? (uint8_t)LineStateFirstChar : mLineStates[currentLine];
+		for (; currentLine < lineCount; currentLine++)
+		{
+			// lines that are now in or out of a comment have different symbols
+			if (mLineStates[currentLine] != state && !mSymbolLines.empty()) {
+				mSymbolRangeMin = std::min(mSymbolRangeMin, currentLine);
+				mSymbolRangeMax = std::max(mSymbolRangeMax, currentLine + 1);
+			}
+			mLineStates[currentLine] = state;
+			state = ScanLineComments(currentLine, state);
+			InvalidateLineLayouts(currentLine, currentLine + 1);
+			mBracketRangeMin = std::min(mBracketRangeMin, currentLine);
+			mBracketRangeMax = std::max(mBracketRangeMax, currentLine + 1);
+
+			if (currentLine + 1 >= mCommentRangeMax && currentLine + 1 < lineCount && mLineStates[currentLine + 1] == state)
+				break;
+		}
+
+		mCommentRangeMin = std::numeric_limits<int>::max();
+		mCommentRangeMax = 0;
+	}
+
+	// colors from the colorizer thread, the old ones are drawn until they arrive
+	while (!mColorizerLines.empty()) {
+		std::unique_ptr<ColorizeJob> job;
+		{
+			std::lock_guard<std::mutex> lock(mColorizerMutex);
+			if (!mColorizerResults.empty()) {
+				job = std::move(mColorizerResults.front());
+				mColorizerResults.pop_front();
+			}
+		}
+		if (job == nullptr)
+			break;
+
+		ApplyColorizeJob(*job);
+		if (std::chrono::steady_clock::now() > deadline)
+			break;
+	}
+
+	// keep the colorizer thread supplied, the jobs are copied while the frame's budget lasts
+	RemoveColorRange((int)mLines.size(), std::numeric_limits<int>::max());
+	size_t jobBytes = (size_t)ColorizerJobBytes;
+	if (mColorizerLanguage->mTokenize == nullptr && !mColorizerLanguage->mTokenDFA.IsCompiled())
+		jobBytes = (size_t)ColorizerRegexJobBytes;
+	jobBytes *= GetColorizerWorkerCount();
+
+	while (!mColorRanges.empty() && (int)mColorizerLines.size() < MaxColorizerJobs && (mColorizerLines.empty() || std::chrono::steady_clock::now() < deadline))
+	{
+		int from = 0, to = 0;
+		NextColorRange((int)mLines.size(), from, to);
+		to = SubmitColorizeJob(from, to, jobBytes, deadline);
+		RemoveColorRange(from, to);
+	}
+}
+
+float TextEditor::TextDistanceToLineStart(const Coordinates& aFrom) const
+{
+	if (auto layout = FindLineLayout(aFrom.mLine, true))
+		return GetLayoutOffset(*layout, GetCharacterIndex(aFrom));
+
+	auto& line = mLines[aFrom.mLine];
+	float distance = 0.0f;
+	float spaceSize = ImGui::GetFont()->CalcTextSizeA(ImGui::GetFontSize(), FLT_MAX, -1.0f, " ", nullptr, nullptr).x;
+	int colIndex = GetCharacterIndex(aFrom);
+	for (size_t it = 0u; it < line.size() && it < colIndex; )
+	{
+		if (line[it].mChar == '\t')
+		{
+			distance = (1.0f + std::floor((1.0f + distance) / (float(mTabSize) * spaceSize))) * (float(mTabSize) * spaceSize);
+			++it;
+		}
+		else
+		{
+			auto d = UTF8CharLength(line[it].mChar);
+			char tempCString[7];
+			int i = 0;
+			for (; i < 6 && d-- > 0 && it < (int)line.size(); i++, it++)
+				tempCString[i] = line[it].mChar;
+
+			tempCString[i] = '\0';
+			distance += ImGui::GetFont()->CalcTextSizeA(ImGui::GetFontSize(), FLT_MAX, -1.0f, tempCString, nullptr, nullptr).x;
+		}
+	}
+
+	return distance;
+}
+
+void TextEditor::UpdateLineLayouts(int aFromLine, int aToLine)
+{
+	// every measurement depends on the font and the tab size
+	ImFont* font = ImGui::GetFont();
+	float fontSize = ImGui::GetFontSize();
+	if (font != mLineLayoutFont || fontSize != mLineLayoutFontSize || mTabSize != mLineLayoutTabSize) {
+		mLineLayouts.clear();
+		mLineLayoutFont = font;
+		mLineLayoutFontSize = fontSize;
+		mLineLayoutTabSize = mTabSize;
+
+		// with the same advance for every printable ASCII character, lines of ASCII text are laid out
+		// from their columns alone: the tab stops of the column math then land on the same pixels too
+		mLineLayoutAdvance = font->CalcTextSizeA(fontSize, FLT_MAX, -1.0f, " ", nullptr, nullptr).x;
+		mLineLayoutMonospace = mLineLayoutAdvance > 1.0f;
+		for (char c = '!'; c <= '~' && mLineLayoutMonospace; c++)
+			mLineLayoutMonospace = font->CalcTextSizeA(fontSize, FLT_MAX, -1.0f, &c, &c + 1, nullptr).x == mLineLayoutAdvance;
+	}
+
+	// keep the layouts of lines that stay in view
+	std::vector<LineLayout> layouts(std::max(0, aToLine - aFromLine));
+	for (int i = std::max(aFromLine, mLineLayoutStart); i < std::min(aToLine, mLineLayoutStart + (int)mLineLayouts.size()); i++)
+		layouts[i - aFromLine] = std::move(mLineLayouts[i - mLineLayoutStart]);
+	mLineLayouts = std::move(layouts);
+	mLineLayoutStart = aFromLine;
+}
+
+void TextEditor::InvalidateLineLayouts(int aFromLine, int aToLine)
+{
+	int from = std::max(aFromLine, mLineLayoutStart) - mLineLayoutStart;
+	int to = (int)std::min<int64_t>((int64_t)aToLine - mLineLayoutStart, (int64_t)mLineLayouts.size());
+	for (int i = from; i < to; i++)
+		mLineLayouts[i].mValid = false;
+}
+
+const TextEditor::LineLayout& TextEditor::GetLineLayout(int aLine)
+{
+	auto& layout = mLineLayouts[aLine - mLineLayoutStart];
+	const auto& line = mLines[aLine];
+	if (layout.mValid && layout.mGlyphCount == (int)line.size())
+		return layout;
+
+	ImFont* font = ImGui::GetFont();
+	float fontSize = ImGui::GetFontSize();
+	float spaceSize = font->CalcTextSizeA(fontSize, FLT_MAX, -1.0f, " ", nullptr, nullptr).x;
+	float tabSize = float(mTabSize) * spaceSize;
+
+	layout.mValid = true;
+	layout.mVertexValid = false;
+	layout.mGlyphCount = (int)line.size();
+	layout.mMonospace = mLineLayoutMonospace && std::none_of(line.begin(), line.end(), [](const Glyph& aGlyph) { return aGlyph.mChar >= 0x80; });
+	layout.mText.clear();
+	layout.mRuns.clear();
+	layout.mOffsets.clear();
+	layout.mTabs.clear();
+	if (!layout.mMonospace)
+		layout.mOffsets.resize(line.size() + 1);
+
+	// a run ends at spaces, tabs and wherever the glyph color could change
+	auto sameColor = [](const Glyph& a, const Glyph& b) {
+		return a.mColorIndex == b.mColorIndex && a.mComment == b.mComment && a.mMultiLineComment == b.mMultiLineComment && a.mPreprocessor == b.mPreprocessor;
+	};
+
+	float x = 0.0f;
+	int column = 0;
+	for (int i = 0; i < (int)line.size(); )
+	{
+		if (!layout.mMonospace)
+			layout.mOffsets[i] = x;
+
+		auto c = line[i].mChar;
+		if (c == '\t')
+		{
+			x = (1.0f + std::floor((1.0f + x) / tabSize)) * tabSize;
+			column = (column / mTabSize) * mTabSize + mTabSize;
+			if (layout.mMonospace)
+				layout.mTabs.push_back({ i, column });
+			i++;
+		}
+		else if (c == ' ')
+		{
+			x += spaceSize;
+			column++;
+			i++;
+		}
+		else
+		{
+			if (layout.mRuns.empty() || layout.mRuns.back().mTextEnd != (int)layout.mText.size() || !sameColor(line[layout.mRuns.back().mGlyph], line[i]))
+				layout.mRuns.push_back({ i, (int)layout.mText.size(), (int)layout.mText.size() });
+
+			int glyph = i, start = (int)layout.mText.size();
+			auto d = UTF8CharLength(c);
+			for (int j = 0; j < 6 && d-- > 0 && i < (int)line.size(); j++)
+				layout.mText.push_back(line[i++].mChar);
+			layout.mRuns.back().mTextEnd = (int)layout.mText.size();
+			column++;
+
+			if (!layout.mMonospace) {
+				x += font->CalcTextSizeA(fontSize, FLT_MAX, -1.0f, layout.mText.c_str() + start, layout.mText.c_str() + layout.mText.size(), nullptr).x;
+				for (int j = glyph + 1; j < i; j++)
+					layout.mOffsets[j] = x; // inside of a multi-byte character
+			}
+		}
+	}
+	if (!layout.mMonospace)
+		layout.mOffsets[line.size()] = x;
+
+	return layout;
+}
+
+const TextEditor::LineLayout* TextEditor::FindLineLayout(int aLine, bool aCheckFont) const
+{
+	int index = aLine - mLineLayoutStart;
+	if (index < 0 || index >= (int)mLineLayouts.size() || !mLineLayouts[index].mValid || mLineLayouts[index].mGlyphCount != (int)mLines[aLine].size() || mTabSize != mLineLayoutTabSize)
+		return nullptr;
+	if (aCheckFont && (ImGui::GetFont() != mLineLayoutFont || ImGui::GetFontSize() != mLineLayoutFontSize))
+		return nullptr;
+	return &mLineLayouts[index];
+}
+
+int TextEditor::GetLayoutColumn(const LineLayout& aLayout, int aIndex) const
+{
+	// the column of the last tab before aIndex, plus one column per character after it
+	auto it = std::lower_bound(aLayout.mTabs.begin(), aLayout.mTabs.end(), aIndex, [](const LineLayout::Tab& aTab, int aIndex) { return aTab.mGlyph < aIndex; });
+	if (it == aLayout.mTabs.begin())
+		return aIndex;
+	--it;
+	return it->mColumnAfter + (aIndex - it->mGlyph - 1);
+}
+
+int TextEditor::GetLayoutIndex(const LineLayout& aLayout, int aColumn) const
+{
+	// first glyph at or after aColumn
+	auto it = std::upper_bound(aLayout.mTabs.begin(), aLayout.mTabs.end(), aColumn, [](int aColumn, const LineLayout::Tab& aTab) { return aColumn < aTab.mColumnAfter; });
+	int index = 0, column = 0;
+	if (it != aLayout.mTabs.begin()) {
+		index = std::prev(it)->mGlyph + 1;
+		column = std::prev(it)->mColumnAfter;
+	}
+	int next = it == aLayout.mTabs.end() ? aLayout.mGlyphCount : it->mGlyph;
+
+	index += aColumn - column;
+	if (index > next)
+		index = next + 1; // aColumn is inside of the next tab
+	return std::min(index, aLayout.mGlyphCount);
+}
+
+float TextEditor::GetLayoutOffset(const LineLayout& aLayout, int aIndex) const
+{
+	aIndex = std::max(0, std::min(aIndex, aLayout.mGlyphCount));
+	if (aLayout.mMonospace)
+		return GetLayoutColumn(aLayout, aIndex) * mLineLayoutAdvance;
+	return aLayout.mOffsets[aIndex];
+}
+
+int TextEditor::HitTestLineLayout(int aLine, const LineLayout& aLayout, float aX, int& aOutTabs) const
+{
+	// first character whose middle is right of aX, or the end of the line
+	int index = aLayout.mGlyphCount;
+	if (aLayout.mMonospace) {
+		int low = 0, high = aLayout.mGlyphCount;
+		while (low < high) {
+			int mid = (low + high) / 2;
+			float middle = (GetLayoutColumn(aLayout, mid) + GetLayoutColumn(aLayout, mid + 1)) * 0.5f * mLineLayoutAdvance;
+			if (middle > aX)
+				high = mid;
+			else
+				low = mid + 1;
+		}
+		index = low;
+
+		aOutTabs = (int)(std::lower_bound(aLayout.mTabs.begin(), aLayout.mTabs.end(), index, [](const LineLayout::Tab& aTab, int aIndex) { return aTab.mGlyph < aIndex; }) - aLayout.mTabs.begin());
+		return index;
+	}
+
+	const auto& line = mLines[aLine];
+	aOutTabs = 0;
+	for (int i = 0; i < aLayout.mGlyphCount; ) {
+		int next = line[i].mChar == '\t' ? i + 1 : std::min(aLayout.mGlyphCount, i + UTF8CharLength(line[i].mChar));
+		if ((aLayout.mOffsets[i] + aLayout.mOffsets[next]) * 0.5f > aX)
+			return i;
+		if (line[i].mChar == '\t')
+			aOutTabs++;
+		i = next;
+	}
+	return index;
+}
+
+void TextEditor::RenderLineLayout(ImDrawList* aDrawList, int aLine, const ImVec2& aPos, float aSpaceSize)
+{
+	auto& layout = mLineLayouts[aLine - mLineLayoutStart];
+	const auto& line = mLines[aLine];
+	const ImVec2 clipMin = aDrawList->GetClipRectMin(), clipMax = aDrawList->GetClipRectMax();
+
+	// the glyphs are placed at whole pixels and culled against the clip rect: an integer translation
+	// with the same horizontal clipping gives the same vertices
+	ImVec2 delta(aPos.x - layout.mVertexPos.x, aPos.y - layout.mVertexPos.y);
+	if (layout.mVertexValid && delta.x == std::floor(delta.x) && delta.y == std::floor(delta.y) &&
+		aPos.x - clipMin.x == layout.mVertexClipX && clipMax.x - clipMin.x == layout.mVertexClipWidth) {
+		int vtxCount = (int)layout.mVertices.size(), idxCount = (int)layout.mIndices.size();
+		aDrawList->PrimReserve(idxCount, vtxCount);
+
+		// PrimReserve() may have started a new vertex offset, indices count from there
+		unsigned int base = aDrawList->VtxBuffer.Size - vtxCount - aDrawList->CmdBuffer.back().VtxOffset;
+		for (auto i : layout.mIndices)
+			aDrawList->PrimWriteIdx((ImDrawIdx)(base + i));
+		for (const auto& v : layout.mVertices)
+			aDrawList->PrimWriteVtx(ImVec2(v.pos.x + delta.x, v.pos.y + delta.y), v.uv, v.col);
+		return;
+	}
+
+	int vtxStart = aDrawList->VtxBuffer.Size, idxStart = aDrawList->IdxBuffer.Size;
+	unsigned int vtxOffset = aDrawList->CmdBuffer.back().VtxOffset, base = vtxStart - vtxOffset;
+
+	for (const auto& run : layout.mRuns)
+	{
+		const ImVec2 offset(aPos.x + GetLayoutOffset(layout, run.mGlyph), aPos.y);
+		aDrawList->AddText(offset, GetGlyphColor(line[run.mGlyph]), layout.mText.c_str() + run.mTextStart, layout.mText.c_str() + run.mTextEnd);
+	}
+
+	if (mShowWhitespaces)
+	{
+		const auto s = ImGui::GetFontSize();
+		const auto y = aPos.y + s * 0.5f;
+		for (int i = 0; i < (int)line.size(); i++)
+		{
+			if (line[i].mChar == '\t')
+			{
+				const auto x1 = aPos.x + GetLayoutOffset(layout, i) + 1.0f;
+				const auto x2 = aPos.x + GetLayoutOffset(layout, i + 1) - 1.0f;
+				const ImVec2 p1(x1, y);
+				const ImVec2 p2(x2, y);
+				const ImVec2 p3(x2 - s * 0.2f, y - s * 0.2f);
+				const ImVec2 p4(x2 - s * 0.2f, y + s * 0.2f);
+				aDrawList->AddLine(p1, p2, 0x90909090);
+				aDrawList->AddLine(p2, p3, 0x90909090);
+				aDrawList->AddLine(p2, p4, 0x90909090);
+			}
+			else if (line[i].mChar == ' ')
+			{
+				const auto x = aPos.x + GetLayoutOffset(layout, i) + aSpaceSize * 0.5f;
+				aDrawList->AddCircleFilled(ImVec2(x, y), 1.5f, 0x80808080, 4);
+			}
+		}
+	}
+
+	// lines cut by the top or bottom edge may be missing glyphs, those are drawn again next frame
+	layout.mVertexValid = false;
+	if (aDrawList->CmdBuffer.back().VtxOffset != vtxOffset || aPos.y < clipMin.y || aPos.y + ImGui::GetFontSize() > clipMax.y)
+		return;
+
+	layout.mVertexValid = true;
+	layout.mVertexPos = aPos;
+	layout.mVertexClipX = aPos.x - clipMin.x;
+	layout.mVertexClipWidth = clipMax.x - clipMin.x;
+	layout.mVertices.assign(aDrawList->VtxBuffer.Data + vtxStart, aDrawList->VtxBuffer.Data + aDrawList->VtxBuffer.Size);
+	layout.mIndices.resize(aDrawList->IdxBuffer.Size - idxStart);
+	for (size_t i = 0; i < layout.mIndices.size(); i++)
+		layout.mIndices[i] = (ImDrawIdx)(aDrawList->IdxBuffer.Data[idxStart + i] - base);
+}
+
+bool TextEditor::FindText(const TextMatcher& aMatcher, const Coordinates& aFrom, Coordinates& aOutStart, Coordinates& aOutEnd)
+{
+	if (!aMatcher.IsValid() || mLines.empty())
+		return false;
+
+	// matches don't span lines: search the rest of the document after aFrom, then wrap around. The line
+	// of aFrom is searched a second time at the end, for matches before aFrom.
+	int firstLine = aFrom.mLine < (int)mLines.size() ? aFrom.mLine : 0;
+	int firstIndex = aFrom.mLine < (int)mLines.size() ? GetCharacterIndex(aFrom) : 0;
+	for (int i = 0; i <= (int)mLines.size(); i++) {
+		int lineNo = (firstLine + i) % (int)mLines.size();
+		const auto& line = mLines[lineNo];
+		mFindLine.resize(line.size());
+		for (size_t j = 0; j < line.size(); j++)
+			mFindLine[j] = line[j].mChar;
+
+		const char* begin = mFindLine.data();
+		const char* matchStart;
+		const char* matchEnd;
+		if (aMatcher.Find(begin, begin + mFindLine.size(), begin + (i == 0 ? firstIndex : 0), matchStart, matchEnd)) {
+			aOutStart = Coordinates(lineNo, GetCharacterColumn(lineNo, (int)(matchStart - begin)));
+			aOutEnd = Coordinates(lineNo, GetCharacterColumn(lineNo, (int)(matchEnd - begin)));
+			return true;
+		}
+	}
+	return false;
+}
+
+int TextEditor::ReplaceAll(const TextMatcher& aMatcher, const std::string& aReplace)
+{
+	assert(aReplace.find_first_of("\r\n") == std::string::npos);
+
+	if (mReadOnly || !aMatcher.IsValid())
+		return 0;
+
+	// build the new text of the lines with matches in one pass, the other lines stay as they are
+	std::vector<std::pair<int, Line>> changed;
+	int count = 0, lastEnd = 0;
+	for (int lineNo = 0; lineNo < (int)mLines.size(); lineNo++) {
+		const auto& line = mLines[lineNo];
+		mFindLine.resize(line.size());
+		for (size_t j = 0; j < line.size(); j++)
+			mFindLine[j] = line[j].mChar;
+
+		const char* begin = mFindLine.data();
+		const char* end = begin + mFindLine.size();
+		const char* matchStart;
+		const char* matchEnd;
+		if (!aMatcher.Find(begin, end, begin, matchStart, matchEnd))
+			continue;
+
+		// the replacement is inserted as it is, regex groups aren't expanded
+		Line newLine = CreateLine();
+		newLine.reserve(line.size());
+		int copied = 0;
+		do {
+			newLine.insert(newLine.end(), line.begin() + copied, line.begin() + (matchStart - begin));
+			for (char c : aReplace)
+				newLine.emplace_back((Char)c, PaletteIndex::Default);
+			copied = (int)(matchEnd - begin);
+			lastEnd = (int)newLine.size();
+			count++;
+		} while (aMatcher.Find(begin, end, matchEnd, matchStart, matchEnd));
+		newLine.insert(newLine.end(), line.begin() + copied, line.end());
+		changed.emplace_back(lineNo, std::move(newLine));
+	}
+	if (changed.empty())
+		return 0;
+
+	// a single undo step covers the lines from the first to the last match
+	int firstLine = changed.front().first, lastLine = changed.back().first;
+	UndoRecord u;
+	u.mBefore = mState;
+	u.mRemovedStart = Coordinates(firstLine, 0);
+	u.mRemovedEnd = Coordinates(lastLine, GetLineMaxColumn(lastLine));
+	u.mRemoved = GetText(u.mRemovedStart, u.mRemovedEnd);
+
+	for (auto& line : changed)
+		mLines[line.first].swap(line.second);
+	InvalidateLineLayouts(firstLine, lastLine + 1);
+
+	u.mAddedStart = u.mRemovedStart;
+	u.mAddedEnd = Coordinates(lastLine, GetLineMaxColumn(lastLine));
+	u.mAdded = GetText(u.mAddedStart, u.mAddedEnd);
+
+	mState.mCursorPosition = mState.mSelectionStart = mState.mSelectionEnd = Coordinates(lastLine, GetCharacterColumn(lastLine, lastEnd));
+	u.mAfter = mState;
+
+	BeginEdit();
+	NotifyTextChange(u.mRemovedStart, u.mRemovedEnd, u.mAddedEnd);
+	NotifyContentUpdate();
+	AddUndo(u);
+	EndEdit();
+
+	return count;
+}
+
+const std::shared_ptr<const TextEditor::TextMatcher>& TextEditor::GetFindMatcher()
+{
+	// compiled again only when the query changes
+	if (mFindMatcher == nullptr || mFindMatcher->GetText() != mFindWord || mFindMatcher->GetFlags() != mFindFlags)
+		mFindMatcher = std::make_shared<const TextMatcher>(mFindWord, mFindFlags);
+	return mFindMatcher;
+}
+
+void TextEditor::SetFindIndexMatcher(const std::shared_ptr<const TextMatcher>& aMatcher)
+{
+	if (aMatcher == mFindIndexMatcher && mFindMatches.size() == mLines.size())
+		return;
+
+	ClearFindIndex();
+	mFindIndexMatcher = aMatcher;
+	mFindMatches.resize(mLines.size());
+	if (aMatcher->IsValid()) {
+		mFindRangeMin = 0;
+		mFindRangeMax = (int)mLines.size();
+	}
+}
+
+void TextEditor::UpdateFindIndex(const std::shared_ptr<const TextMatcher>& aMatcher, const std::chrono::steady_clock::time_point& aDeadline)
+{
+	SetFindIndexMatcher(aMatcher);
+
+	// matches from the search thread, a chunk of lines at a time
+	if (mSearchBusy) {
+		std::unique_ptr<SearchJob> job;
+		{
+			std::lock_guard<std::mutex> lock(mSearchMutex);
+			job = std::move(mSearchResult);
+		}
+		if (job == nullptr)
+			return;
+
+		mSearchBusy = false;
+		ApplySearchJob(*job);
+	}
+	if (mFindRangeMin >= mFindRangeMax)
+		return;
+
+	// small chunks, so that the first matches show up within a few frames
+	std::unique_ptr<SearchJob> job = CreateSearchJob(256 * 1024, aDeadline);
+	mSearchLineStart = job->mFromLine;
+	mSearchLineEnd = job->mFromLine + (int)job->mLineEnds.size();
+	{
+		std::lock_guard<std::mutex> lock(mSearchMutex);
+		mSearchJob = std::move(job);
+	}
+	if (!mSearchThread.joinable())
+		mSearchThread = std::thread(&TextEditor::SearchThread, this);
+	mSearchCondition.notify_all();
+
+	mSearchBusy = true;
+}
+
+void TextEditor::CompleteFindIndex(const std::shared_ptr<const TextMatcher>& aMatcher)
+{
+	SetFindIndexMatcher(aMatcher);
+
+	// the job on the search thread is waited for, the rest is searched right here
+	if (mSearchBusy) {
+		std::unique_ptr<SearchJob> job;
+		{
+			std::unique_lock<std::mutex> lock(mSearchMutex);
+			mSearchCondition.wait(lock, [this] { return mSearchResult != nullptr; });
+			job = std::move(mSearchResult);
+		}
+		mSearchBusy = false;
+		ApplySearchJob(*job);
+	}
+	if (mFindRangeMin < mFindRangeMax) {
+		std::unique_ptr<SearchJob> job = CreateSearchJob(std::numeric_limits<int>::max(), std::chrono::steady_clock::time_point::max());
+		RunSearchJob(*job);
+		ApplySearchJob(*job);
+	}
+}
+
+void TextEditor::ClearFindIndex()
+{
+	if (mFindIndexMatcher == nullptr && mFindMatches.empty())
+		return;
+
+	mSearchGeneration++; // abandons the job on the search thread
+	mFindIndexMatcher.reset();
+	mFindMatches.clear();
+	mFindMatchTree.clear();
+	mFindMatchTreeValid = false;
+	mFindMatchCount = 0;
+	mFindRangeMin = std::numeric_limits<int>::max();
+	mFindRangeMax = 0;
+}
+
+std::unique_ptr<TextEditor::SearchJob> TextEditor::CreateSearchJob(int aMaxBytes, const std::chrono::steady_clock::time_point& aDeadline)
+{
+	std::unique_ptr<SearchJob> job(new SearchJob());
+	job->mFromLine = mFindRangeMin;
+	job->mGeneration = mSearchGeneration;
+	job->mCancelled = false;
+	job->mMatcher = mFindIndexMatcher;
+
+	// the rest is copied in the next frames
+	int line = mFindRangeMin;
+	int lastLine = std::min(mFindRangeMax, (int)mLines.size());
+	while (line < lastLine && (int)job->mText.size() < aMaxBytes) {
+		for (const auto& glyph : mLines[line])
+			job->mText.push_back(glyph.mChar);
+		job->mLineEnds.push_back((int)job->mText.size());
+		line++;
+
+		if ((line - job->mFromLine) % 256 == 0 && std::chrono::steady_clock::now() > aDeadline)
+			break;
+	}
+
+	mFindRangeMin = line;
+	if (mFindRangeMin >= lastLine) {
+		mFindRangeMin = std::numeric_limits<int>::max();
+		mFindRangeMax = 0;
+	}
+	return job;
+}
+
+void TextEditor::ApplySearchJob(const SearchJob& aJob)
+{
+	// the query changed or the lines were edited meanwhile, they are back in the search range already
+	if (aJob.mCancelled || aJob.mGeneration != mSearchGeneration)
+		return;
+
+	int start = 0;
+	for (int i = 0; i < (int)aJob.mLineEnds.size(); i++) {
+		auto& matches = mFindMatches[aJob.mFromLine + i];
+		int oldCount = (int)matches.size();
+		matches.assign(aJob.mMatches.begin() + start, aJob.mMatches.begin() + aJob.mMatchEnds[i]);
+		start = aJob.mMatchEnds[i];
+
+		mFindMatchCount += (int)matches.size() - oldCount;
+		AddFindMatches(aJob.mFromLine + i, (int)matches.size() - oldCount);
+	}
+}
+
+void TextEditor::RunSearchJob(SearchJob& aJob) const
+{
+	const char* text = aJob.mText.data();
+	int start = 0;
+	for (int i = 0; i < (int)aJob.mLineEnds.size(); i++) {
+		// a new query or an edit makes the rest of the job useless
+		if (i % 64 == 0 && mSearchGeneration != aJob.mGeneration) {
+			aJob.mCancelled = true;
+			return;
+		}
+
+		const char* begin = text + start;
+		const char* end = text + aJob.mLineEnds[i];
+		const char* matchStart;
+		const char* matchEnd;
+		for (const char* from = begin; aJob.mMatcher->Find(begin, end, from, matchStart, matchEnd); from = matchEnd)
+			aJob.mMatches.push_back({ (int)(matchStart - begin), (int)(matchEnd - begin) });
+		aJob.mMatchEnds.push_back((int)aJob.mMatches.size());
+		start = aJob.mLineEnds[i];
+	}
+}
+
+void TextEditor::SearchThread()
+{
+	std::unique_lock<std::mutex> lock(mSearchMutex);
+	while (true) {
+		mSearchCondition.wait(lock, [this] { return mSearchExit || mSearchJob != nullptr; });
+		if (mSearchExit)
+			break;
+
+		std::unique_ptr<SearchJob> job = std::move(mSearchJob);
+		lock.unlock();
+
+		RunSearchJob(*job);
+
+		lock.lock();
+		mSearchResult = std::move(job);
+		mSearchCondition.notify_all(); // CompleteFindIndex() might be waiting
+	}
+}
+
+int TextEditor::GetIdentifierCount(const std::string& aName) const
+{
+	auto it = mSymbolCounts.find(aName);
+	return it == mSymbolCounts.end() ? 0 : it->second;
+}
+
+void TextEditor::UpdateSymbolIndex(const std::chrono::steady_clock::time_point& aDeadline)
+{
+	if (mSymbolLines.size() != mLines.size()) {
+		ClearSymbolIndex();
+		mSymbolLines.resize(mLines.size());
+		mSymbolRangeMin = 0;
+		mSymbolRangeMax = (int)mLines.size();
+	}
+
+	// symbols from the symbol thread, a chunk of lines at a time
+	if (mSymbolBusy) {
+		std::unique_ptr<SymbolJob> job;
+		{
+			std::lock_guard<std::mutex> lock(mSymbolMutex);
+			job = std::move(mSymbolResult);
+		}
+		if (job == nullptr)
+			return;
+
+		mSymbolBusy = false;
+		ApplySymbolJob(*job);
+	}
+
+	if (mSymbolRangeMin < mSymbolRangeMax) {
+		std::unique_ptr<SymbolJob> job = CreateSymbolJob(256 * 1024, aDeadline);
+		mSymbolLineStart = job->mFromLine;
+		mSymbolLineEnd = job->mFromLine + (int)job->mLineEnds.size();
+		{
+			std::lock_guard<std::mutex> lock(mSymbolMutex);
+			mSymbolJob = std::move(job);
+		}
+		if (!mSymbolThread.joinable())
+			mSymbolThread = std::thread(&TextEditor::SymbolThread, this);
+		mSymbolCondition.notify_one();
+
+		mSymbolBusy = true;
+		return;
+	}
+
+	// the declarations depend on the lines around them, they are collected once every line is scanned
+	if (mSymbolsChanged)
+		BuildDocumentSymbols();
+}
+
+void TextEditor::ClearSymbolIndex()
+{
+	if (mSymbolLines.empty() && mSymbolCounts.empty() && mDocumentSymbols.mFunctions.empty() && mDocumentSymbols.mTypes.empty() &&
+		mDocumentSymbols.mUniforms.empty() && mDocumentSymbols.mGlobals.empty())
+		return;
+
+	mSymbolGeneration++; // abandons the job on the symbol thread
+	mSymbolLines.clear();
+	mSymbolCounts.clear();
+	mSymbolRangeMin = std::numeric_limits<int>::max();
+	mSymbolRangeMax = 0;
+	mSymbolsChanged = false;
+	mACDocumentChanged = true;
+
+	if (!mDocumentSymbols.mFunctions.empty() || !mDocumentSymbols.mTypes.empty() || !mDocumentSymbols.mUniforms.empty() || !mDocumentSymbols.mGlobals.empty()) {
+		mDocumentSymbols = DocumentSymbols();
+		mColorizerSymbols.reset();
+		Colorize();
+	}
+}
+
+void TextEditor::CountSymbols(const LineSymbols& aLine, int aSign)
+{
+	// autocomplete only needs to know when a word appears or disappears
+	for (const auto& name : aLine.mNames) {
+		if (aSign > 0) {
+			if (mSymbolCounts[name]++ == 0)
+				mACDocumentChanged = true;
+		} else {
+			auto it = mSymbolCounts.find(name);
+			if (it != mSymbolCounts.end() && --it->second <= 0) {
+				mSymbolCounts.erase(it);
+				mACDocumentChanged = true;
+			}
+		}
+	}
+}
+
+std::unique_ptr<TextEditor::SymbolJob> TextEditor::CreateSymbolJob(int aMaxBytes, const std::chrono::steady_clock::time_point& aDeadline)
+{
+	std::unique_ptr<SymbolJob> job(new SymbolJob());
+	job->mFromLine = mSymbolRangeMin;
+	job->mGeneration = mSymbolGeneration;
+	job->mCancelled = false;
+
+	// the rest is copied in the next frames
+	int line = mSymbolRangeMin;
+	int lastLine = std::min(mSymbolRangeMax, (int)mLines.size());
+	while (line < lastLine && (int)job->mText.size() < aMaxBytes) {
+		for (const auto& glyph : mLines[line])
+			job->mText.push_back((glyph.mComment || glyph.mMultiLineComment) ? ' ' : glyph.mChar);
+		job->mLineEnds.push_back((int)job->mText.size());
+		line++;
+
+		if ((line - job->mFromLine) % 256 == 0 && std::chrono::steady_clock::now() > aDeadline)
+			break;
+	}
+
+	mSymbolRangeMin = line;
+	if (mSymbolRangeMin >= lastLine) {
+		mSymbolRangeMin = std::numeric_limits<int>::max();
+		mSymbolRangeMax = 0;
+	}
+	return job;
+}
+
+void TextEditor::ApplySymbolJob(SymbolJob& aJob)
+{
+	// the lines were edited meanwhile, they are back in the symbol range already
+	if (aJob.mCancelled || aJob.mGeneration != mSymbolGeneration)
+		return;
+
+	for (int i = 0; i < (int)aJob.mLines.size(); i++) {
+		auto& line = mSymbolLines[aJob.mFromLine + i];
+		CountSymbols(line, -1);
+		line = std::move(aJob.mLines[i]);
+		CountSymbols(line, 1);
+	}
+	mSymbolsChanged = true;
+}
+
+void TextEditor::RunSymbolJob(SymbolJob& aJob) const
+{
+	const char* text = aJob.mText.data();
+	aJob.mLines.resize(aJob.mLineEnds.size());
+
+	int start = 0;
+	for (int i = 0; i < (int)aJob.mLineEnds.size(); i++) {
+		// an edit makes the rest of the job useless
+		if (i % 64 == 0 && mSymbolGeneration != aJob.mGeneration) {
+			aJob.mCancelled = true;
+			return;
+		}
+
+		ScanLineSymbols(text + start, text + aJob.mLineEnds[i], aJob.mLines[i]);
+		start = aJob.mLineEnds[i];
+	}
+}
+
+void TextEditor::SymbolThread()
+{
+	std::unique_lock<std::mutex> lock(mSymbolMutex);
+	while (true) {
+		mSymbolCondition.wait(lock, [this] { return mSymbolExit || mSymbolJob != nullptr; });
+		if (mSymbolExit)
+			break;
+
+		std::unique_ptr<SymbolJob> job = std::move(mSymbolJob);
+		lock.unlock();
+
+		RunSymbolJob(*job);
+
+		lock.lock();
+		mSymbolResult = std::move(job);
+	}
+}
+
+void TextEditor::BuildDocumentSymbols()
+{
+	DocumentSymbols symbols;
+	std::unordered_set<std::string> types, uniforms, globals, locals;
+	auto addOnce = [](std::unordered_set<std::string>& aSeen, std::vector<std::string>& aList, const std::string& aName) {
+		if (aSeen.insert(aName).second)
+			aList.push_back(aName);
+	};
+
+	int depth = 0;				// braces open at the start of the line
+	int function = -1;			// in symbols.mFunctions, the function whose body is being read
+	int functionDepth = 0;
+	bool functionEntered = false;
+	int uniformDepth = -1;		// depth of the cbuffer or uniform block being read
+	bool uniformEntered = false;
+	for (int lineNo = 0; lineNo < (int)mSymbolLines.size(); lineNo++) {
+		const auto& line = mSymbolLines[lineNo];
+		bool declaration = false;
+
+		if (function == -1 && !line.mFunction.empty()) {
+			symbols.mFunctions.push_back(std::make_pair(line.mFunction, FunctionData(lineNo + 1, lineNo + 1, line.mArguments, std::vector<std::string>())));
+			function = (int)symbols.mFunctions.size() - 1;
+			functionDepth = depth;
+			functionEntered = line.mFunctionOpens;
+			locals.clear();
+			locals.insert(line.mArguments.begin(), line.mArguments.end());
+			declaration = true;
+		} else if (function != -1 && !functionEntered && line.mFirstChar != 0) {
+			// only empty lines can come between the declaration and its body
+			functionEntered = line.mFirstChar == '{';
+			if (!functionEntered) {
+				symbols.mFunctions.pop_back();
+				function = -1;
+			}
+		}
+
+		if (function != -1 && functionEntered) {
+			auto& data = symbols.mFunctions[function].second;
+			for (const auto& name : line.mDeclared)
+				addOnce(locals, data.Locals, name);
+
+			// the body ends where the braces get back to the depth of the declaration
+			int lowest = (declaration || data.LineEnd == lineNo) ? line.mBraceDelta : line.mBraceMin;
+			data.LineEnd = lineNo + 1;
+			if (depth + lowest <= functionDepth && (!declaration || line.mBraceMax > 0))
+				function = -1;
+		} else if (function == -1 && !declaration) {
+			if (uniformDepth != -1 && depth > uniformDepth) {
+				uniformEntered = true;
+				for (const auto& name : line.mDeclared)
+					addOnce(uniforms, symbols.mUniforms, name);
+			} else if (depth == 0) {
+				for (const auto& name : line.mDeclared)
+					addOnce(line.mUniform ? uniforms : globals, line.mUniform ? symbols.mUniforms : symbols.mGlobals, name);
+			}
+			if (uniformDepth != -1 && depth <= uniformDepth && (uniformEntered || (line.mFirstChar != 0 && line.mFirstChar != '{' && !line.mUniformBlock)))
+				uniformDepth = -1;
+			if (line.mUniformBlock && uniformDepth == -1) {
+				uniformDepth = depth;
+				uniformEntered = false;
+			}
+		}
+		for (const auto& name : line.mTypes)
+			addOnce(types, symbols.mTypes, name);
+
+		depth = std::max(0, depth + line.mBraceDelta);
+	}
+
+	mSymbolsChanged = false;
+
+	// recolor the functions that moved or changed, or everything when names came or went
+	auto sameFunction = [](const std::pair<std::string, FunctionData>& a, const std::pair<std::string, FunctionData>& b) {
+		return a.first == b.first && a.second.LineStart == b.second.LineStart && a.second.LineEnd == b.second.LineEnd &&
+			a.second.Arguments == b.second.Arguments && a.second.Locals == b.second.Locals;
+	};
+	auto& old = mDocumentSymbols;
+	bool sameNames = old.mTypes == symbols.mTypes && old.mUniforms == symbols.mUniforms && old.mGlobals == symbols.mGlobals && old.mFunctions.size() == symbols.mFunctions.size();
+	for (size_t i = 0; sameNames && i < symbols.mFunctions.size(); i++)
+		sameNames = old.mFunctions[i].first == symbols.mFunctions[i].first;
+
+	bool changed = !sameNames;
+	if (sameNames) {
+		for (size_t i = 0; i < symbols.mFunctions.size(); i++) {
+			if (sameFunction(old.mFunctions[i], symbols.mFunctions[i]))
+				continue;
+			for (const auto* data : { &old.mFunctions[i].second, &symbols.mFunctions[i].second })
+				Colorize(data->LineStart - 4, data->LineEnd - data->LineStart + 6);
+			changed = true;
+		}
+	} else
+		Colorize();
+
+	if (changed) {
+		mDocumentSymbols = std::move(symbols);
+		mColorizerSymbols.reset();
+		mACDocumentChanged = true;
+	}
+}
+
+// 0 - (), 1 - [], 2 - {}, -1 for other characters
+static int GetBracketKind(TextEditor::Char aChar, int& aDirection)
+{
+	switch (aChar) {
+	case '(': aDirection = 1; return 0;
+	case ')': aDirection = -1; return 0;
+	case '[': aDirection = 1; return 1;
+	case ']': aDirection = -1; return 1;
+	case '{': aDirection = 1; return 2;
+	case '}': aDirection = -1; return 2;
+	default: aDirection = 0; return -1;
+	}
+}
+
+TextEditor::BracketSpan TextEditor::MergeBracketSpans(const BracketSpan& aLeft, const BracketSpan& aRight)
+{
+	BracketSpan ret;
+	for (int kind = 0; kind < BracketKinds; kind++) {
+		ret.mDepth[kind] = aLeft.mDepth[kind] + aRight.mDepth[kind];
+		ret.mMinDepth[kind] = std::min(aLeft.mMinDepth[kind], aLeft.mDepth[kind] + aRight.mMinDepth[kind]);
+		ret.mMaxSuffix[kind] = std::max(aRight.mMaxSuffix[kind], aRight.mDepth[kind] + aLeft.mMaxSuffix[kind]);
+	}
+	return ret;
+}
+void TextEditor::ScanLineBrackets(int aLine, std::vector<int>& aOut) const
+{
+	aOut.clear();
+	const auto& line = mLines[aLine];
+
+	// comments are flagged by the colorizer, strings are followed from the state the line starts in
+	bool withinString = aLine < (int)mLineStates.size() && mLineStates[aLine] != LineStateInvalid && (mLineStates[aLine] & LineStateString) != 0;
+	for (int i = 0; i < (int)line.size(); i++) {
+		const auto& g = line[i];
+		if (g.mComment || g.mMultiLineComment)
+			continue;
+
+		Char c = g.mChar;
+		int direction = 0;
+		if (withinString) {
+			if (c == '\\' || (c == '\"' && i + 1 < (int)line.size() && line[i + 1].mChar == '\"'))
+				i++;
+			else if (c == '\"')
+				withinString = false;
+		}
+		else if (c == '\"')
+			withinString = true;
+		else if (c == '\'') {
+			// character literal, when it's closed on the same line
+			int end = i + 1;
+			while (end < (int)line.size() && line[end].mChar != '\'')
+				end += line[end].mChar == '\\' ? 2 : 1;
+			if (end < (int)line.size())
+				i = end;
+		}
+		else if (GetBracketKind(c, direction) != -1)
+			aOut.push_back(i);
+	}
+}
+void TextEditor::UpdateBracketIndex()
+{
+	if (mBracketLineCount != (int)mLines.size())
+		ResetBracketBlocks();
+
+	int fromLine = std::max(0, mBracketRangeMin);
+	int toLine = std::min((int)mLines.size(), mBracketRangeMax);
+	mBracketRangeMin = std::numeric_limits<int>::max();
+	mBracketRangeMax = 0;
+	if (fromLine < toLine) {
+		mBracketHighlightValid = false;
+
+		std::vector<int> brackets;
+		int block = FindBracketBlock(fromLine);
+		for (int line = fromLine; line < toLine; line++) {
+			while (line >= mBracketBlockStart[block] + (int)mBracketBlocks[block].mLines.size())
+				block++;
+			ScanLineBrackets(line, brackets);
+
+			BracketSpan& span = mBracketBlocks[block].mLines[line - mBracketBlockStart[block]];
+			span = BracketSpan();
+			for (int index : brackets) {
+				int direction = 0, kind = GetBracketKind(mLines[line][index].mChar, direction);
+				span.mDepth[kind] += direction;
+				span.mMinDepth[kind] = std::min(span.mMinDepth[kind], span.mDepth[kind]);
+			}
+			int suffix[BracketKinds] = {};
+			for (auto it = brackets.rbegin(); it != brackets.rend(); ++it) {
+				int direction = 0, kind = GetBracketKind(mLines[line][*it].mChar, direction);
+				suffix[kind] += direction;
+				span.mMaxSuffix[kind] = std::max(span.mMaxSuffix[kind], suffix[kind]);
+			}
+			mBracketBlocks[block].mChanged = true;
+		}
+	}
+
+	BuildBracketTree();
+}
+void TextEditor::BuildBracketTree()
+{
+	bool changed = false;
+	for (auto& block : mBracketBlocks) {
+		if (block.mChanged) {
+			block.mSpan = BracketSpan();
+			for (const auto& span : block.mLines)
+				block.mSpan = MergeBracketSpans(block.mSpan, span);
+			block.mChanged = false;
+			changed = true;
+		}
+	}
+	if (!changed)
+		return;
+
+	// only a few hundred blocks, the whole tree is built again
+	mBracketLeaves = 1;
+	while (mBracketLeaves < (int)mBracketBlocks.size())
+		mBracketLeaves *= 2;
+
+	mBracketTree.assign(mBracketLeaves * 2, BracketSpan());
+	for (size_t i = 0; i < mBracketBlocks.size(); i++)
+		mBracketTree[mBracketLeaves + i] = mBracketBlocks[i].mSpan;
+	for (int node = mBracketLeaves - 1; node > 0; node--)
+		mBracketTree[node] = MergeBracketSpans(mBracketTree[node * 2], mBracketTree[node * 2 + 1]);
+}
+void TextEditor::ResetBracketBlocks()
+{
+	mBracketLineCount = (int)mLines.size();
+	mBracketBlocks.clear();
+	mBracketBlockStart.clear();
+	for (int line = 0; line < mBracketLineCount || mBracketBlocks.empty(); line += BracketBlockSize) {
+		mBracketBlocks.emplace_back();
+		mBracketBlocks.back().mLines.resize(std::min((int)BracketBlockSize, mBracketLineCount - line));
+		mBracketBlocks.back().mChanged = true;
+		mBracketBlockStart.push_back(line);
+	}
+	mBracketRangeMin = 0;
+	mBracketRangeMax = mBracketLineCount;
+}
+void TextEditor::SpliceBracketLines(int aLine, int aRemoved, int aInserted)
+{
+	int block = FindBracketBlock(aLine);
+	int offset = aLine - mBracketBlockStart[block];
+
+	int lastBlock = block;
+	for (int removed = aRemoved, at = offset; removed > 0; lastBlock++, at = 0) {
+		auto& lines = mBracketBlocks[lastBlock].mLines;
+		int count = std::min(removed, (int)lines.size() - at);
+		lines.erase(lines.begin() + at, lines.begin() + at + count);
+		mBracketBlocks[lastBlock].mChanged = true;
+		removed -= count;
+	}
+	auto& lines = mBracketBlocks[block].mLines;
+	lines.insert(lines.begin() + offset, aInserted, BracketSpan());
+	mBracketBlocks[block].mChanged = true;
+	mBracketLineCount += aInserted - aRemoved;
+
+	// empty blocks are dropped and large ones split
+	bool rearrange = false;
+	for (int i = block; i <= std::min(lastBlock, (int)mBracketBlocks.size() - 1); i++)
+		rearrange |= mBracketBlocks[i].mLines.empty() || mBracketBlocks[i].mLines.size() > 2 * BracketBlockSize;
+	if (rearrange) {
+		std::vector<BracketBlock> blocks;
+		for (auto& old : mBracketBlocks) {
+			if (old.mLines.size() <= 2 * BracketBlockSize) {
+				if (!old.mLines.empty())
+					blocks.push_back(std::move(old));
+				continue;
+			}
+			for (size_t from = 0; from < old.mLines.size(); from += BracketBlockSize) {
+				blocks.emplace_back();
+				blocks.back().mLines.assign(old.mLines.begin() + from, old.mLines.begin() + std::min(old.mLines.size(), from + BracketBlockSize));
+				blocks.back().mChanged = true;
+			}
+		}
+		if (blocks.empty())
+			blocks.emplace_back();
+		blocks.front().mChanged = true; // the tree is built again for the new block count
+		mBracketBlocks = std::move(blocks);
+	}
+
+	mBracketBlockStart.resize(mBracketBlocks.size());
+	for (size_t i = 0, line = 0; i < mBracketBlocks.size(); line += mBracketBlocks[i].mLines.size(), i++)
+		mBracketBlockStart[i] = (int)line;
+}
+int TextEditor::FindBracketBlock(int aLine) const
+{
+	auto it = std::upper_bound(mBracketBlockStart.begin(), mBracketBlockStart.end(), aLine);
+	return std::max(0, (int)(it - mBracketBlockStart.begin()) - 1);
+}
+int TextEditor::FindBracketBlockAfter(int aKind, int aNode, int aFrom, int aTo, int aBlock, int& aDepth) const
+{
+	// first block at or after aBlock where the depth drops to 0, aDepth is moved over the blocks before it
+	if (aTo <= aBlock)
+		return -1;
+	const BracketSpan& span = mBracketTree[aNode];
+	if (aFrom >= aBlock && aDepth + span.mMinDepth[aKind] > 0) {
+		aDepth += span.mDepth[aKind];
+		return -1;
+	}
+	if (aTo - aFrom == 1)
+		return aFrom;
+
+	int mid = (aFrom + aTo) / 2;
+	int ret = FindBracketBlockAfter(aKind, aNode * 2, aFrom, mid, aBlock, aDepth);
+	return ret != -1 ? ret : FindBracketBlockAfter(aKind, aNode * 2 + 1, mid, aTo, aBlock, aDepth);
+}
+int TextEditor::FindBracketBlockBefore(int aKind, int aNode, int aFrom, int aTo, int aBlock, int& aDepth) const
+{
+	// last block before aBlock with an unmatched opening bracket for each of the aDepth closing ones
+	if (aFrom >= aBlock)
+		return -1;
+	const BracketSpan& span = mBracketTree[aNode];
+	if (aTo <= aBlock && span.mMaxSuffix[aKind] < aDepth) {
+		aDepth -= span.mDepth[aKind];
+		return -1;
+	}
+	if (aTo - aFrom == 1)
+		return aFrom;
 
-				for (size_t j = 0; j < token_length; ++j)
-					line[(token_begin - bufferBegin) + j].mColorIndex = token_color;
+	int mid = (aFrom + aTo) / 2;
+	int ret = FindBracketBlockBefore(aKind, aNode * 2 + 1, mid, aTo, aBlock, aDepth);
+	return ret != -1 ? ret : FindBracketBlockBefore(aKind, aNode * 2, aFrom, mid, aBlock, aDepth);
+}
+int TextEditor::FindBracketLineAfter(int aKind, int aLine, int& aDepth) const
+{
+	if (aLine >= mBracketLineCount)
+		return -1;
 
-				first = token_end;
-			}
+	// the rest of the block, then the block where the depth drops to 0
+	int block = FindBracketBlock(aLine);
+	int offset = aLine - mBracketBlockStart[block];
+	while (true) {
+		const auto& lines = mBracketBlocks[block].mLines;
+		for (int i = offset; i < (int)lines.size(); i++) {
+			if (aDepth + lines[i].mMinDepth[aKind] <= 0)
+				return mBracketBlockStart[block] + i;
+			aDepth += lines[i].mDepth[aKind];
 		}
+
+		block = FindBracketBlockAfter(aKind, 1, 0, mBracketLeaves, block + 1, aDepth);
+		if (block == -1 || block >= (int)mBracketBlocks.size())
+			return -1;
+		offset = 0;
 	}
 }
-
-void TextEditor::ColorizeInternal()
+int TextEditor::FindBracketLineBefore(int aKind, int aLine, int& aDepth) const
 {
-	if (mLines.empty() || !mColorizerEnabled)
-		return;
-
-	if (mCheckComments)
-	{
-		auto endLine = mLines.size();
-		auto endIndex = 0;
-		auto commentStartLine = endLine;
-		auto commentStartIndex = endIndex;
-		auto withinString = false;
-		auto withinSingleLineComment = false;
-		auto withinPreproc = false;
-		auto firstChar = true;			// there is no other non-whitespace characters in the line before
-		auto concatenate = false;		// '\' on the very end of the line
-		auto currentLine = 0;
-		auto currentIndex = 0;
-		while (currentLine < endLine || currentIndex < endIndex)
-		{
-			auto& line = mLines[currentLine];
+	if (aLine <= 0)
+		return -1;
 
-			if (currentIndex == 0 && !concatenate)
-			{
-				withinSingleLineComment = false;
-				withinPreproc = false;
-				firstChar = true;
-			}
+	int block = FindBracketBlock(aLine - 1);
+	int offset = aLine - 1 - mBracketBlockStart[block];
+	while (true) {
+		const auto& lines = mBracketBlocks[block].mLines;
+		for (int i = offset; i >= 0; i--) {
+			if (lines[i].mMaxSuffix[aKind] >= aDepth)
+				return mBracketBlockStart[block] + i;
+			aDepth -= lines[i].mDepth[aKind];
+		}
 
-			concatenate = false;
+		block = FindBracketBlockBefore(aKind, 1, 0, mBracketLeaves, block, aDepth);
+		if (block == -1)
+			return -1;
+		offset = (int)mBracketBlocks[block].mLines.size() - 1;
+	}
+}
+bool TextEditor::FindBracketMatch(int aLine, int aIndex, int& aOutLine, int& aOutIndex)
+{
+	if (aLine < 0 || aLine >= (int)mLines.size() || aIndex < 0 || aIndex >= (int)mLines[aLine].size())
+		return false;
+	UpdateBracketIndex();
 
-			if (!line.empty())
-			{
-				auto& g = line[currentIndex];
-				auto c = g.mChar;
+	std::vector<int> brackets;
+	ScanLineBrackets(aLine, brackets);
+	auto it = std::lower_bound(brackets.begin(), brackets.end(), aIndex);
+	if (it == brackets.end() || *it != aIndex)
+		return false;
 
-				if (c != mLanguageDefinition.mPreprocChar && !isspace(c))
-					firstChar = false;
+	// brackets of the same kind in the rest of the line, then in the line where the depth gets back to 0
+	int direction = 0, kind = GetBracketKind(mLines[aLine][aIndex].mChar, direction);
+	int depth = 0;
+	auto scan = [&](int aLine, int aFrom) {
+		for (int i = aFrom; i >= 0 && i < (int)brackets.size(); i += direction) {
+			int dir = 0;
+			if (GetBracketKind(mLines[aLine][brackets[i]].mChar, dir) == kind && (depth += dir * direction) == 0)
+				return brackets[i];
+		}
+		return -1;
+	};
 
-				if (currentIndex == (int)line.size() - 1 && line[line.size() - 1].mChar == '\\')
-					concatenate = true;
+	aOutLine = aLine;
+	aOutIndex = scan(aLine, (int)(it - brackets.begin()));
+	if (aOutIndex != -1)
+		return true;
 
-				bool inComment = (commentStartLine < currentLine || (commentStartLine == currentLine && commentStartIndex <= currentIndex));
+	if (direction > 0)
+		aOutLine = FindBracketLineAfter(kind, aLine + 1, depth);
+	else
+		aOutLine = FindBracketLineBefore(kind, aLine, depth);
+	if (aOutLine == -1)
+		return false;
 
-				if (withinString)
-				{
-					line[currentIndex].mMultiLineComment = inComment;
+	ScanLineBrackets(aOutLine, brackets);
+	aOutIndex = scan(aOutLine, direction > 0 ? 0 : (int)brackets.size() - 1);
+	return aOutIndex != -1;
+}
+bool TextEditor::FindMatchingBracket(const Coordinates& aPosition, Coordinates& aOut)
+{
+	int line, index;
+	if (aPosition.mLine < 0 || aPosition.mLine >= (int)mLines.size() ||
+		!FindBracketMatch(aPosition.mLine, GetCharacterIndex(aPosition), line, index))
+		return false;
 
-					if (c == '\"')
-					{
-						if (currentIndex + 1 < (int)line.size() && line[currentIndex + 1].mChar == '\"')
-						{
-							currentIndex += 1;
-							if (currentIndex < (int)line.size())
-								line[currentIndex].mMultiLineComment = inComment;
-						}
-						else
-							withinString = false;
-					}
-					else if (c == '\\')
-					{
-						currentIndex += 1;
-						if (currentIndex < (int)line.size())
-							line[currentIndex].mMultiLineComment = inComment;
-					}
-				}
-				else
-				{
-					if (firstChar && c == mLanguageDefinition.mPreprocChar)
-						withinPreproc = true;
+	aOut = Coordinates(line, GetCharacterColumn(line, index));
+	return true;
+}
+void TextEditor::UpdateBracketHighlight()
+{
+	if (mBracketHighlightValid && mBracketHighlightCursor == mState.mCursorPosition)
+		return;
+	mBracketHighlightValid = true;
+	mBracketHighlightCursor = mState.mCursorPosition;
+
+	// the bracket after the cursor, or the one before it
+	mBracketHighlight[0] = mBracketHighlight[1] = std::make_pair(-1, -1);
+	Coordinates cursor = GetActualCursorCoordinates();
+	int index = GetCharacterIndex(cursor);
+	for (int at = index; at >= std::max(0, index - 1); at--) {
+		int line, match;
+		if (FindBracketMatch(cursor.mLine, at, line, match)) {
+			mBracketHighlight[0] = std::make_pair(cursor.mLine, at);
+			mBracketHighlight[1] = std::make_pair(line, match);
+			break;
+		}
+	}
+}
 
-					if (c == '\"')
-					{
-						withinString = true;
-						line[currentIndex].mMultiLineComment = inComment;
-					}
-					else
-					{
-						auto pred = [](const char& a, const Glyph& b) { return a == b.mChar; };
-						auto from = line.begin() + currentIndex;
-						auto& startStr = mLanguageDefinition.mCommentStart;
-						auto& singleStartStr = mLanguageDefinition.mSingleLineComment;
-
-						if (singleStartStr.size() > 0 &&
-							currentIndex + singleStartStr.size() <= line.size() &&
-							equals(singleStartStr.begin(), singleStartStr.end(), from, from + singleStartStr.size(), pred))
-						{
-							withinSingleLineComment = true;
-						}
-						else if (!withinSingleLineComment && currentIndex + startStr.size() <= line.size() &&
-							equals(startStr.begin(), startStr.end(), from, from + startStr.size(), pred))
-						{
-							commentStartLine = currentLine;
-							commentStartIndex = currentIndex;
-						}
+void TextEditor::BuildFindMatchTree()
+{
+	int lineCount = (int)mFindMatches.size();
+	mFindMatchTree.assign(lineCount + 1, 0);
+	for (int i = 1; i <= lineCount; i++) {
+		mFindMatchTree[i] += (int)mFindMatches[i - 1].size();
+		int parent = i + (i & -i);
+		if (parent <= lineCount)
+			mFindMatchTree[parent] += mFindMatchTree[i];
+	}
+	mFindMatchTreeValid = true;
+}
 
-						inComment = inComment = (commentStartLine < currentLine || (commentStartLine == currentLine && commentStartIndex <= currentIndex));
+void TextEditor::AddFindMatches(int aLine, int aCount)
+{
+	// rebuilt when it's needed next
+	if (!mFindMatchTreeValid || aCount == 0)
+		return;
 
-						line[currentIndex].mMultiLineComment = inComment;
-						line[currentIndex].mComment = withinSingleLineComment;
+	for (int i = aLine + 1; i < (int)mFindMatchTree.size(); i += i & -i)
+		mFindMatchTree[i] += aCount;
+}
 
-						auto& endStr = mLanguageDefinition.mCommentEnd;
-						if (currentIndex + 1 >= (int)endStr.size() &&
-							equals(endStr.begin(), endStr.end(), from + 1 - endStr.size(), from + 1, pred))
-						{
-							commentStartIndex = endIndex;
-							commentStartLine = endLine;
-						}
-					}
-				}
-				line[currentIndex].mPreprocessor = withinPreproc;
-				currentIndex += UTF8CharLength(c);
-				if (currentIndex >= (int)line.size())
-				{
-					currentIndex = 0;
-					++currentLine;
-				}
-			}
-			else
-			{
-				currentIndex = 0;
-				++currentLine;
-			}
-		}
-		mCheckComments = false;
-	}
+int TextEditor::GetFindMatchesBefore(int aLine)
+{
+	if (!mFindMatchTreeValid)
+		BuildFindMatchTree();
 
-	if (mColorRangeMin < mColorRangeMax)
-	{
-		const int increment = (mLanguageDefinition.mTokenize == nullptr) ? 10 : 10000;
-		const int to = std::min<int>(mColorRangeMin + increment, mColorRangeMax);
-		ColorizeRange(mColorRangeMin, to);
-		mColorRangeMin = to;
+	int count = 0;
+	for (int i = std::min(aLine, (int)mFindMatchTree.size() - 1); i > 0; i -= i & -i)
+		count += mFindMatchTree[i];
+	return count;
+}
 
-		if (mColorRangeMax == mColorRangeMin)
-		{
-			mColorRangeMin = std::numeric_limits<int>::max();
-			mColorRangeMax = 0;
+int TextEditor::GetFindMatchLine(int aIndex)
+{
+	if (!mFindMatchTreeValid)
+		BuildFindMatchTree();
+
+	// the last line before which there are at most aIndex matches
+	int lineCount = (int)mFindMatchTree.size() - 1;
+	int line = 0;
+	int step = 1;
+	while (step * 2 <= lineCount)
+		step *= 2;
+	for (; step > 0; step /= 2) {
+		if (line + step <= lineCount && mFindMatchTree[line + step] <= aIndex) {
+			line += step;
+			aIndex -= mFindMatchTree[line];
 		}
-		return;
 	}
+	return line;
 }
 
-float TextEditor::TextDistanceToLineStart(const Coordinates& aFrom) const
+bool TextEditor::FindIndexed(const Coordinates& aFrom, bool aBackwards, Coordinates& aOutStart, Coordinates& aOutEnd)
 {
-	auto& line = mLines[aFrom.mLine];
-	float distance = 0.0f;
-	float spaceSize = ImGui::GetFont()->CalcTextSizeA(ImGui::GetFontSize(), FLT_MAX, -1.0f, " ", nullptr, nullptr).x;
-	int colIndex = GetCharacterIndex(aFrom);
-	for (size_t it = 0u; it < line.size() && it < colIndex; )
-	{
-		if (line[it].mChar == '\t')
-		{
-			distance = (1.0f + std::floor((1.0f + distance) / (float(mTabSize) * spaceSize))) * (float(mTabSize) * spaceSize);
-			++it;
-		}
-		else
-		{
-			auto d = UTF8CharLength(line[it].mChar);
-			char tempCString[7];
-			int i = 0;
-			for (; i < 6 && d-- > 0 && it < (int)line.size(); i++, it++)
-				tempCString[i] = line[it].mChar;
+	if (mFindMatchCount == 0 || !IsFindIndexComplete())
+		return false;
 
-			tempCString[i] = '\0';
-			distance += ImGui::GetFont()->CalcTextSizeA(ImGui::GetFontSize(), FLT_MAX, -1.0f, tempCString, nullptr, nullptr).x;
+	int fromLine = std::min(aFrom.mLine, (int)mLines.size() - 1);
+	int fromIndex = GetCharacterIndex(Coordinates(fromLine, aFrom.mColumn));
+	const auto& fromMatches = mFindMatches[fromLine];
+
+	int lineNo = -1;
+	const FindMatch* match = nullptr;
+	if (!aBackwards) {
+		// the next match in the same line, or the first one in the next line with matches
+		for (const auto& m : fromMatches)
+			if (m.mStart >= fromIndex) {
+				lineNo = fromLine;
+				match = &m;
+				break;
+			}
+		if (match == nullptr) {
+			int before = GetFindMatchesBefore(fromLine + 1);
+			lineNo = GetFindMatchLine(before < mFindMatchCount ? before : 0);
+			match = &mFindMatches[lineNo].front();
+		}
+	} else {
+		for (auto it = fromMatches.rbegin(); it != fromMatches.rend(); ++it)
+			if (it->mStart < fromIndex) {
+				lineNo = fromLine;
+				match = &*it;
+				break;
+			}
+		if (match == nullptr) {
+			int before = GetFindMatchesBefore(fromLine);
+			lineNo = GetFindMatchLine(before > 0 ? before - 1 : mFindMatchCount - 1);
+			match = &mFindMatches[lineNo].back();
 		}
 	}
 
-	return distance;
+	aOutStart = Coordinates(lineNo, GetCharacterColumn(lineNo, match->mStart));
+	aOutEnd = Coordinates(lineNo, GetCharacterColumn(lineNo, match->mEnd));
+	return true;
 }
 
 void TextEditor::EnsureCursorVisible()
@@ -4078,6 +7085,349 @@ void TextEditor::UndoRecord::Redo(TextEditor * aEditor)
 	aEditor->EnsureCursorVisible();
 }
 
+// character class scanning for the tokenizers, 16 characters at a time with SSE2
+#ifdef TEXTEDITOR_SSE2
+static inline int FirstSetBit(unsigned int aMask)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, aMask);
+	return (int)index;
+#else
+	return __builtin_ctz(aMask);
+#endif
+}
+// 0xFF for every byte in [aLow, aHigh]
+static inline __m128i InRange(__m128i aChars, char aLow, char aHigh)
+{
+	__m128i shifted = _mm_xor_si128(_mm_sub_epi8(aChars, _mm_set1_epi8(aLow)), _mm_set1_epi8((char)0x80));
+	return _mm_cmplt_epi8(shifted, _mm_set1_epi8((char)((aHigh - aLow + 1) ^ 0x80)));
+}
+#endif
+
+static inline bool IsIdentifierChar(char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+// end of the run of [a-zA-Z0-9_] starting at p
+static const char* SkipIdentifierChars(const char* p, const char* end)
+{
+#ifdef TEXTEDITOR_SSE2
+	for (; end - p >= 16; p += 16) {
+		__m128i chars = _mm_loadu_si128((const __m128i*)p);
+		__m128i letters = InRange(_mm_or_si128(chars, _mm_set1_epi8(0x20)), 'a', 'z');
+		__m128i digits = InRange(chars, '0', '9');
+		__m128i underscores = _mm_cmpeq_epi8(chars, _mm_set1_epi8('_'));
+		unsigned int other = ~_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(letters, digits), underscores)) & 0xFFFF;
+		if (other != 0)
+			return p + FirstSetBit(other);
+	}
+#endif
+	while (p < end && IsIdentifierChar(*p))
+		p++;
+	return p;
+}
+
+// end of the run of [0-9] starting at p
+static const char* SkipDigits(const char* p, const char* end)
+{
+#ifdef TEXTEDITOR_SSE2
+	for (; end - p >= 16; p += 16) {
+		__m128i chars = _mm_loadu_si128((const __m128i*)p);
+		unsigned int other = ~_mm_movemask_epi8(InRange(chars, '0', '9')) & 0xFFFF;
+		if (other != 0)
+			return p + FirstSetBit(other);
+	}
+#endif
+	while (p < end && *p >= '0' && *p <= '9')
+		p++;
+	return p;
+}
+
+// end of the run of spaces and tabs starting at p
+static const char* SkipBlanks(const char* p, const char* end)
+{
+#ifdef TEXTEDITOR_SSE2
+	for (; end - p >= 16; p += 16) {
+		__m128i chars = _mm_loadu_si128((const __m128i*)p);
+		__m128i blanks = _mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(chars, _mm_set1_epi8('\t')));
+		unsigned int other = ~_mm_movemask_epi8(blanks) & 0xFFFF;
+		if (other != 0)
+			return p + FirstSetBit(other);
+	}
+#endif
+	while (p < end && (*p == ' ' || *p == '\t'))
+		p++;
+	return p;
+}
+
+// first '"' or '\\' at or after p, end if there is none
+static const char* FindQuoteOrEscape(const char* p, const char* end)
+{
+#ifdef TEXTEDITOR_SSE2
+	for (; end - p >= 16; p += 16) {
+		__m128i chars = _mm_loadu_si128((const __m128i*)p);
+		__m128i found = _mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8('"')), _mm_cmpeq_epi8(chars, _mm_set1_epi8('\\')));
+		unsigned int mask = _mm_movemask_epi8(found);
+		if (mask != 0)
+			return p + FirstSetBit(mask);
+	}
+#endif
+	while (p < end && *p != '"' && *p != '\\')
+		p++;
+	return p;
+}
+
+static inline char ToLowerAscii(char c)
+{
+	return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+}
+static inline char ToUpperAscii(char c)
+{
+	return (c >= 'a' && c <= 'z') ? (char)(c - 'a' + 'A') : c;
+}
+
+// true unless p is between two identifier characters
+static inline bool IsWordBoundary(const char* aBegin, const char* aEnd, const char* p)
+{
+	return p == aBegin || p == aEnd || !IsIdentifierChar(p[-1]) || !IsIdentifierChar(*p);
+}
+
+TextEditor::TextMatcher::TextMatcher(const std::string& aText, int aFlags)
+	: mText(aText)
+	, mNeedle(aText)
+	, mFlags(aFlags)
+	, mValid(!aText.empty())
+{
+	if ((mFlags & FlagRegex) && mValid) {
+		// the find bar text is typed by the user, it doesn't have to be a valid regex
+		try {
+			auto options = std::regex_constants::ECMAScript | std::regex_constants::optimize;
+			if (mFlags & FlagIgnoreCase)
+				options |= std::regex_constants::icase;
+			mRegex = std::regex(mText, options);
+		} catch (const std::regex_error&) {
+			mValid = false;
+		}
+	} else if (mFlags & FlagIgnoreCase)
+		std::transform(mNeedle.begin(), mNeedle.end(), mNeedle.begin(), ToLowerAscii);
+}
+
+bool TextEditor::TextMatcher::Find(const char* aBegin, const char* aEnd, const char* aFrom, const char*& aOutStart, const char*& aOutEnd) const
+{
+	if (!mValid)
+		return false;
+
+	while (aFrom <= aEnd) {
+		const char* start;
+		const char* end;
+		if (mFlags & FlagRegex) {
+			// the text before aFrom is still seen by ^ and \b
+			std::cmatch match;
+			auto flags = aFrom > aBegin ? std::regex_constants::match_prev_avail : std::regex_constants::match_default;
+			if (!std::regex_search(aFrom, aEnd, match, mRegex, flags))
+				return false;
+			start = match[0].first;
+			end = match[0].second;
+		} else {
+			start = FindLiteral(aFrom, aEnd);
+			if (start == nullptr)
+				return false;
+			end = start + mNeedle.size();
+		}
+
+		// empty regex matches are skipped, like the ones of "a*"
+		if (start != end && (!(mFlags & FlagWholeWord) || (IsWordBoundary(aBegin, aEnd, start) && IsWordBoundary(aBegin, aEnd, end)))) {
+			aOutStart = start;
+			aOutEnd = end;
+			return true;
+		}
+		aFrom = start + 1;
+	}
+	return false;
+}
+
+const char* TextEditor::TextMatcher::FindLiteral(const char* aFrom, const char* aEnd) const
+{
+	const size_t length = mNeedle.size();
+	if (length == 0 || (size_t)(aEnd - aFrom) < length)
+		return nullptr;
+
+	// mNeedle is lower case when the case is ignored, the candidate is lowered while comparing
+	const bool ignoreCase = (mFlags & FlagIgnoreCase) != 0;
+	auto matchesRest = [&](const char* p) {
+		if (!ignoreCase)
+			return memcmp(p + 1, mNeedle.data() + 1, length - 1) == 0;
+		for (size_t i = 1; i < length; i++)
+			if (ToLowerAscii(p[i]) != mNeedle[i])
+				return false;
+		return true;
+	};
+
+	const char* p = aFrom;
+	const char* last = aEnd - length; // last position a match can start at
+#ifdef TEXTEDITOR_SSE2
+	const char firstChar = mNeedle.front(), finalChar = mNeedle.back();
+	const __m128i first = _mm_set1_epi8(firstChar);
+	const __m128i firstOther = _mm_set1_epi8(ignoreCase ? ToUpperAscii(firstChar) : firstChar);
+	const __m128i final = _mm_set1_epi8(finalChar);
+	const __m128i finalOther = _mm_set1_epi8(ignoreCase ? ToUpperAscii(finalChar) : finalChar);
+	for (; last - p >= 15; p += 16) {
+		__m128i head = _mm_loadu_si128((const __m128i*)p);
+		__m128i tail = _mm_loadu_si128((const __m128i*)(p + length - 1));
+		__m128i starts = _mm_or_si128(_mm_cmpeq_epi8(head, first), _mm_cmpeq_epi8(head, firstOther));
+		__m128i ends = _mm_or_si128(_mm_cmpeq_epi8(tail, final), _mm_cmpeq_epi8(tail, finalOther));
+		unsigned int mask = _mm_movemask_epi8(_mm_and_si128(starts, ends));
+		while (mask != 0) {
+			int bit = FirstSetBit(mask);
+			if (matchesRest(p + bit))
+				return p + bit;
+			mask &= mask - 1;
+		}
+	}
+#endif
+	if (ignoreCase) {
+		for (; p <= last; p++)
+			if (ToLowerAscii(*p) == mNeedle.front() && matchesRest(p))
+				return p;
+		return nullptr;
+	}
+	while (p <= last) {
+		p = (const char*)memchr(p, mNeedle.front(), last - p + 1);
+		if (p == nullptr)
+			return nullptr;
+		if (matchesRest(p))
+			return p;
+		p++;
+	}
+	return nullptr;
+}
+
+// words that come before an identifier without declaring it
+static bool IsStatementKeyword(std::string_view aWord)
+{
+	static const char* const keywords[] = { "return", "else", "case", "goto", "new", "delete", "throw", "typedef", "using", "namespace",
+		"if", "while", "for", "switch", "do", "sizeof", "struct", "class", "cbuffer", "tbuffer", "enum", "union", "template", "operator", "define", "undef",
+		"ifdef", "ifndef", "include", "pragma", "public", "private", "protected" };
+	for (const char* keyword : keywords)
+		if (aWord == keyword)
+			return true;
+	return false;
+}
+
+void TextEditor::ScanLineSymbols(const char* aBegin, const char* aEnd, LineSymbols& aOut)
+{
+	// identifiers and punctuation, without strings and numbers
+	std::vector<std::string_view> tokens;
+	const char* p = SkipBlanks(aBegin, aEnd);
+	aOut.mFirstChar = p < aEnd ? *p : 0;
+	while (p < aEnd) {
+		const char* start = p;
+		if (*p == '"' || *p == '\'') {
+			for (p++; p < aEnd && *p != *start; p++)
+				if (*p == '\\')
+					p++;
+			p = std::min(p + 1, aEnd);
+		} else if (*p >= '0' && *p <= '9') {
+			while (p < aEnd && (IsIdentifierChar(*p) || *p == '.'))
+				p++;
+		} else if (IsIdentifierChar(*p)) {
+			p = SkipIdentifierChars(p, aEnd);
+			tokens.emplace_back(start, p - start);
+		} else if (*p != ' ' && *p != '\t')
+			tokens.emplace_back(p++, 1);
+		else
+			p = SkipBlanks(p, aEnd);
+	}
+
+	auto isName = [&](size_t i) { return i < tokens.size() && IsIdentifierChar(tokens[i][0]); };
+	auto isChar = [&](size_t i, char c) { return i < tokens.size() && tokens[i].size() == 1 && tokens[i][0] == c; };
+	auto follows = [&](size_t i, const char* aChars) { return i < tokens.size() && !isName(i) && strchr(aChars, tokens[i][0]) != nullptr; };
+
+	int parens = 0, braces = 0;
+	size_t skipUntil = 0; // parameters of the function, they aren't declarations on this line
+	for (size_t i = 0; i < tokens.size(); i++) {
+		std::string_view token = tokens[i];
+		if (!isName(i)) {
+			switch (token[0]) {
+			case '(': parens++; break;
+			case ')': parens = std::max(0, parens - 1); break;
+			case '{': aOut.mBraceMax = std::max(aOut.mBraceMax, ++braces); break;
+			case '}': aOut.mBraceMin = std::min(aOut.mBraceMin, --braces); break;
+			}
+			continue;
+		}
+		aOut.mNames.emplace_back(token);
+
+		if ((token == "struct" || token == "class" || token == "cbuffer" || token == "tbuffer") && isName(i + 1)) {
+			aOut.mTypes.emplace_back(tokens[i + 1]);
+			aOut.mUniformBlock |= token == "cbuffer" || token == "tbuffer";
+		}
+		if (token == "uniform") {
+			aOut.mUniform = true;
+			aOut.mUniformBlock |= isName(i + 1) && (i + 2 == tokens.size() || isChar(i + 2, '{'));
+		}
+
+		// "type name"
+		if (i < skipUntil || !isName(i + 1) || IsStatementKeyword(token) || IsStatementKeyword(tokens[i + 1]))
+			continue;
+
+		if (isChar(i + 2, '(') && parens == 0 && braces == 0 && aOut.mFunction.empty()) {
+			// parameters: the last name of every parameter that has a type
+			std::vector<std::string> arguments;
+			std::string_view last;
+			int names = 0, depth = 1;
+			bool stopped = false; // past the name, in a semantic, default value or array size
+			size_t j = i + 3;
+			for (; j < tokens.size() && depth > 0; j++) {
+				if (isName(j)) {
+					if (depth == 1 && !stopped) {
+						last = tokens[j];
+						names++;
+					}
+					continue;
+				}
+				char c = tokens[j][0];
+				if (c == '(')
+					depth++;
+				else if (c == ')')
+					depth--;
+				if (depth == 0 || (depth == 1 && c == ',')) {
+					if (names >= 2)
+						arguments.emplace_back(last);
+					names = 0;
+					stopped = false;
+				} else if (depth == 1 && (c == ':' || c == '=' || c == '['))
+					stopped = true;
+			}
+
+			// only a semantic or a qualifier can come between the parameters and the body
+			size_t k = j;
+			if (depth == 0 && isChar(k, ':') && isName(k + 1))
+				k += 2;
+			while (isName(k) && (tokens[k] == "const" || tokens[k] == "override" || tokens[k] == "noexcept"))
+				k++;
+			if (depth == 0 && (k == tokens.size() || isChar(k, '{'))) {
+				aOut.mFunction = std::string(tokens[i + 1]);
+				aOut.mArguments = std::move(arguments);
+				aOut.mFunctionOpens = k < tokens.size();
+				skipUntil = j;
+			}
+			continue;
+		}
+
+		if (follows(i + 2, "=;,[:") && (parens == 0 || follows(i + 2, "=:"))) {
+			aOut.mDeclared.emplace_back(tokens[i + 1]);
+
+			// int a, b, c;
+			for (size_t k = i + 2; parens == 0 && isChar(k, ',') && isName(k + 1) && (k + 2 == tokens.size() || follows(k + 2, "=;,[")); k += 2)
+				aOut.mDeclared.emplace_back(tokens[k + 1]);
+		}
+	}
+	aOut.mBraceDelta = braces;
+}
+
 static bool TokenizeCStyleString(const char* in_begin, const char* in_end, const char*& out_begin, const char*& out_end)
 {
 	const char* p = in_begin;
@@ -4086,7 +7436,7 @@ static bool TokenizeCStyleString(const char* in_begin, const char* in_end, const
 	{
 		p++;
 
-		while (p < in_end)
+		while ((p = FindQuoteOrEscape(p, in_end)) < in_end)
 		{
 			// handle end of string
 			if (*p == '"')
@@ -4140,10 +7490,7 @@ static bool TokenizeCStyleIdentifier(const char* in_begin, const char* in_end, c
 
 	if ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') || *p == '_')
 	{
-		p++;
-
-		while ((p < in_end) && ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') || (*p >= '0' && *p <= '9') || *p == '_'))
-			p++;
+		p = SkipIdentifierChars(p + 1, in_end);
 
 		out_begin = in_begin;
 		out_end = p;
@@ -4164,14 +7511,9 @@ static bool TokenizeCStyleNumber(const char* in_begin, const char* in_end, const
 
 	p++;
 
-	bool hasNumber = startsWithNumber;
-
-	while (p < in_end && (*p >= '0' && *p <= '9'))
-	{
-		hasNumber = true;
-
-		p++;
-	}
+	const char* digitsEnd = SkipDigits(p, in_end);
+	bool hasNumber = startsWithNumber || digitsEnd != p;
+	p = digitsEnd;
 
 	if (hasNumber == false)
 		return false;
@@ -4186,10 +7528,7 @@ static bool TokenizeCStyleNumber(const char* in_begin, const char* in_end, const
 		{
 			isFloat = true;
 
-			p++;
-
-			while (p < in_end && (*p >= '0' && *p <= '9'))
-				p++;
+			p = SkipDigits(p + 1, in_end);
 		}
 		else if (*p == 'x' || *p == 'X')
 		{
@@ -4227,17 +7566,10 @@ static bool TokenizeCStyleNumber(const char* in_begin, const char* in_end, const
 			if (p < in_end && (*p == '+' || *p == '-'))
 				p++;
 
-			bool hasDigits = false;
-
-			while (p < in_end && (*p >= '0' && *p <= '9'))
-			{
-				hasDigits = true;
-
-				p++;
-			}
-
-			if (hasDigits == false)
+			const char* exponentEnd = SkipDigits(p, in_end);
+			if (exponentEnd == p)
 				return false;
+			p = exponentEnd;
 		}
 
 		// single precision floating point type
@@ -4297,9 +7629,7 @@ static bool TokenizeCStylePunctuation(const char * in_begin, const char * in_end
 
 const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::CPlusPlus()
 {
-	static bool inited = false;
-	static LanguageDefinition langDef;
-	if (!inited)
+	static const std::shared_ptr<const LanguageDefinition> shared = Share([](LanguageDefinition& langDef)
 	{
 		static const char* const cppKeywords[] = {
 			"alignas", "alignof", "and", "and_eq", "asm", "atomic_cancel", "atomic_commit", "atomic_noexcept", "auto", "bitand", "bitor", "bool", "break", "case", "catch", "char", "char16_t", "char32_t", "class",
@@ -4327,8 +7657,7 @@ const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::CPlusPlus(
 		{
 			paletteIndex = PaletteIndex::Max;
 
-			while (in_begin < in_end && isascii(*in_begin) && isblank(*in_begin))
-				in_begin++;
+			in_begin = SkipBlanks(in_begin, in_end);
 
 			if (in_begin == in_end)
 			{
@@ -4358,17 +7687,13 @@ const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::CPlusPlus(
 		langDef.mAutoIndentation = true;
 
 		langDef.mName = "C++";
-
-		inited = true;
-	}
-	return langDef;
+	});
+	return *shared;
 }
 
 const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::HLSL()
 {
-	static bool inited = false;
-	static LanguageDefinition langDef;
-	if (!inited)
+	static const std::shared_ptr<const LanguageDefinition> shared = Share([](LanguageDefinition& langDef)
 	{
 		static const char* const keywords[] = {
 			"AppendStructuredBuffer", "asm", "asm_fragment", "BlendState", "bool", "break", "Buffer", "ByteAddressBuffer", "case", "cbuffer", "centroid", "class", "column_major", "compile", "compile_fragment",
@@ -4411,10 +7736,8 @@ const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::HLSL()
 		langDef.mAutoIndentation = true;
 
 		langDef.mName = "HLSL";
-
-		inited = true;
-	}
-	return langDef;
+	});
+	return *shared;
 }
 void TextEditor::LanguageDefinition::m_HLSLDocumentation(Identifiers& idents)
 {
@@ -4559,9 +7882,7 @@ void TextEditor::LanguageDefinition::m_HLSLDocumentation(Identifiers& idents)
 
 const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::GLSL()
 {
-	static bool inited = false;
-	static LanguageDefinition langDef;
-	if (!inited)
+	static const std::shared_ptr<const LanguageDefinition> shared = Share([](LanguageDefinition& langDef)
 	{
 		static const char* const keywords[] = {
 			"auto", "break", "case", "char", "const", "continue", "default", "do", "double", "else", "enum", "extern", "float", "for", "goto", "if", "inline", "int", "long", "register", "restrict", "return", "short",
@@ -4598,10 +7919,8 @@ const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::GLSL()
 		langDef.mAutoIndentation = true;
 
 		langDef.mName = "GLSL";
-
-		inited = true;
-	}
-	return langDef;
+	});
+	return *shared;
 }
 void TextEditor::LanguageDefinition::m_GLSLDocumentation(Identifiers& idents)
 {
@@ -4754,9 +8073,7 @@ void TextEditor::LanguageDefinition::m_GLSLDocumentation(Identifiers& idents)
 
 const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::C()
 {
-	static bool inited = false;
-	static LanguageDefinition langDef;
-	if (!inited)
+	static const std::shared_ptr<const LanguageDefinition> shared = Share([](LanguageDefinition& langDef)
 	{
 		static const char* const keywords[] = {
 			"auto", "break", "case", "char", "const", "continue", "default", "do", "double", "else", "enum", "extern", "float", "for", "goto", "if", "inline", "int", "long", "register", "restrict", "return", "short",
@@ -4781,8 +8098,7 @@ const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::C()
 		{
 			paletteIndex = PaletteIndex::Max;
 
-			while (in_begin < in_end && isascii(*in_begin) && isblank(*in_begin))
-				in_begin++;
+			in_begin = SkipBlanks(in_begin, in_end);
 
 			if (in_begin == in_end)
 			{
@@ -4812,17 +8128,13 @@ const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::C()
 		langDef.mAutoIndentation = true;
 
 		langDef.mName = "C";
-
-		inited = true;
-	}
-	return langDef;
+	});
+	return *shared;
 }
 
 const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::SQL()
 {
-	static bool inited = false;
-	static LanguageDefinition langDef;
-	if (!inited)
+	static const std::shared_ptr<const LanguageDefinition> shared = Share([](LanguageDefinition& langDef)
 	{
 		static const char* const keywords[] = {
 			"ADD", "EXCEPT", "PERCENT", "ALL", "EXEC", "PLAN", "ALTER", "EXECUTE", "PRECISION", "AND", "EXISTS", "PRIMARY", "ANY", "EXIT", "PRINT", "AS", "FETCH", "PROC", "ASC", "FILE", "PROCEDURE",
@@ -4876,17 +8188,13 @@ const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::SQL()
 		langDef.mAutoIndentation = false;
 
 		langDef.mName = "SQL";
-
-		inited = true;
-	}
-	return langDef;
+	});
+	return *shared;
 }
 
 const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::AngelScript()
 {
-	static bool inited = false;
-	static LanguageDefinition langDef;
-	if (!inited)
+	static const std::shared_ptr<const LanguageDefinition> shared = Share([](LanguageDefinition& langDef)
 	{
 		static const char* const keywords[] = {
 			"and", "abstract", "auto", "bool", "break", "case", "cast", "class", "const", "continue", "default", "do", "double", "else", "enum", "false", "final", "float", "for",
@@ -4926,17 +8234,13 @@ const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::AngelScrip
 		langDef.mAutoIndentation = true;
 
 		langDef.mName = "AngelScript";
-
-		inited = true;
-	}
-	return langDef;
+	});
+	return *shared;
 }
 
 const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::Lua()
 {
-	static bool inited = false;
-	static LanguageDefinition langDef;
-	if (!inited)
+	static const std::shared_ptr<const LanguageDefinition> shared = Share([](LanguageDefinition& langDef)
 	{
 		static const char* const keywords[] = {
 			"and", "break", "do", "", "else", "elseif", "end", "false", "for", "function", "if", "in", "", "local", "nil", "not", "or", "repeat", "return", "then", "true", "until", "while"
@@ -4980,8 +8284,6 @@ const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::Lua()
 		langDef.mAutoIndentation = false;
 
 		langDef.mName = "Lua";
-
-		inited = true;
-	}
-	return langDef;
+	});
+	return *shared;
 }
\ No newline at end of file
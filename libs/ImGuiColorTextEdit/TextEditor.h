@@ -1,13 +1,18 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
+#include <deque>
 #include <array>
 #include <memory>
 #include <unordered_set>
 #include <unordered_map>
 #include <functional>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 #include <map>
 #include <regex>
 #include <imgui/imgui.h>
@@ -99,6 +104,7 @@ public:
 		Find,
 		Replace,
 		FindNext,
+		FindPrevious,
 		DebugStep,
 		DebugStepInto,
 		DebugStepOut,
@@ -251,7 +257,83 @@ public:
 		}
 	};
 
-	typedef std::vector<Glyph> Line;
+	// Chunked pool that owns the glyph storage of every line in the editor.
+	// Freed blocks go back into per-size free lists, and Reset() drops all chunks at once.
+	// Define TEXTEDITOR_NO_LINE_ARENA to give every line its own heap block instead, so that
+	// sanitizers catch accesses past the end of a line.
+	class LineArena {
+	public:
+		LineArena();
+		~LineArena();
+
+		void* Allocate(size_t aBytes);
+		void Deallocate(void* aPtr, size_t aBytes);
+		void Reset();
+
+		inline size_t GetBytesUsed() const { return mBytesUsed; }
+		inline size_t GetBytesReserved() const { return mBytesReserved; }
+
+	private:
+		LineArena(const LineArena&) = delete;
+		LineArena& operator=(const LineArena&) = delete;
+
+		static const size_t ChunkSize = 64 * 1024;
+		static const size_t MinBlockSize = 16;
+		static const int SizeClassCount = 9; // 16 bytes .. 4 KB, larger blocks bypass the pool
+
+		static int mGetSizeClass(size_t aBytes);
+
+		std::vector<char*> mChunks;
+		char* mChunkCursor;
+		char* mChunkEnd;
+		void* mFreeLists[SizeClassCount];
+		size_t mBytesUsed;
+		size_t mBytesReserved;
+	};
+
+	template<typename T>
+	class LineAllocator {
+	public:
+		typedef T value_type;
+		typedef std::true_type propagate_on_container_copy_assignment;
+		typedef std::true_type propagate_on_container_move_assignment;
+		typedef std::true_type propagate_on_container_swap;
+
+		LineAllocator() noexcept : mArena(nullptr) { }
+		explicit LineAllocator(LineArena* aArena) noexcept : mArena(aArena) { }
+		template<typename U>
+		LineAllocator(const LineAllocator<U>& aOther) noexcept : mArena(aOther.mArena) { }
+
+		T* allocate(size_t n)
+		{
+#ifndef TEXTEDITOR_NO_LINE_ARENA
+			if (mArena != nullptr)
+				return static_cast<T*>(mArena->Allocate(n * sizeof(T)));
+#endif
+			return static_cast<T*>(::operator new(n * sizeof(T)));
+		}
+		void deallocate(T* p, size_t n)
+		{
+#ifndef TEXTEDITOR_NO_LINE_ARENA
+			if (mArena != nullptr) {
+				mArena->Deallocate(p, n * sizeof(T));
+				return;
+			}
+#else
+			(void)n;
+#endif
+			::operator delete(p);
+		}
+
+		template<typename U>
+		bool operator==(const LineAllocator<U>& aOther) const { return mArena == aOther.mArena; }
+		template<typename U>
+		bool operator!=(const LineAllocator<U>& aOther) const { return mArena != aOther.mArena; }
+
+		LineArena* mArena;
+	};
+
+	typedef std::vector<Glyph, LineAllocator<Glyph>> Line;
 	typedef std::vector<Line> Lines;
 
 	struct LanguageDefinition {
@@ -281,6 +363,7 @@ public:
 		{
 		}
 
+		// built-in definitions, created on first use and shared by every editor
 		static const LanguageDefinition& CPlusPlus();
 		static const LanguageDefinition& HLSL();
 		static const LanguageDefinition& GLSL();
@@ -290,6 +373,7 @@ public:
 		static const LanguageDefinition& Lua();
 
 	private:
+		static std::shared_ptr<const LanguageDefinition> Share(void(*aBuild)(LanguageDefinition&));
 		static void m_HLSLDocumentation(Identifiers& idents);
 		static void m_GLSLDocumentation(Identifiers& idents);
 	};
@@ -298,19 +382,20 @@ public:
 	~TextEditor();
 
 	void SetLanguageDefinition(const LanguageDefinition& aLanguageDef);
-	const LanguageDefinition& GetLanguageDefinition() const { return mLanguageDefinition; }
+	void SetLanguageDefinition(const std::shared_ptr<const LanguageDefinition>& aLanguageDef); // shared, must not change afterwards
+	const LanguageDefinition& GetLanguageDefinition() const { return *mLanguageDefinition; }
 
 	const Palette& GetPalette() const { return mPaletteBase; }
 	void SetPalette(const Palette& aValue);
 
-	void SetErrorMarkers(const ErrorMarkers& aMarkers) { mErrorMarkers = aMarkers; }
+	void SetErrorMarkers(const ErrorMarkers& aMarkers);
 
 	bool HasBreakpoint(int line);
 	void AddBreakpoint(int line, std::string condition = "", bool enabled = true);
 	void RemoveBreakpoint(int line);
 	void SetBreakpointEnabled(int line, bool enable);
 	Breakpoint& GetBreakpoint(int line);
-	inline const std::vector<Breakpoint>& GetBreakpoints() { return mBreakpoints; }
+	const std::vector<Breakpoint>& GetBreakpoints(); // sorted by line
 	void SetCurrentLineIndicator(int line);
 
 	inline bool IsDebugging() { return mDebugCurrentLine > 0; }
@@ -326,6 +411,8 @@ public:
 	std::string GetCurrentLineText() const;
 
 	int GetTotalLines() const { return (int)mLines.size(); }
+	size_t GetLineMemoryUsed() const { return mLineArena->GetBytesUsed(); }
+	size_t GetLineMemoryReserved() const { return mLineArena->GetBytesReserved(); }
 	bool IsOverwrite() const { return mOverwrite; }
 
 	bool IsFocused() const { return mFocused; }
@@ -334,9 +421,22 @@ public:
 	bool IsTextChanged() const { return mTextChanged; }
 	bool IsCursorPositionChanged() const { return mCursorPositionChanged; }
 	inline void ResetTextChanged() { mTextChanged = false; }
+	inline unsigned int GetVersion() const { return mVersion; } // increased on every change
 
 	bool IsColorizerEnabled() const { return mColorizerEnabled; }
 	void SetColorizerEnable(bool aValue);
+	inline void SetColorizerThreadCount(int aCount) { mColorizerThreadCount = aCount; } // 0 - one thread per core
+	inline int GetColorizerThreadCount() const { return mColorizerThreadCount; }
+	inline double GetColorizerLinesPerSecond() const { return mColorizerLinesPerSecond; } // throughput of the last colorizer job
+
+	// functions, variables and types declared in the text itself, used for autocomplete and coloring next to the autocomplete data
+	inline void SetDocumentSymbolsEnabled(bool aValue) { mDocumentSymbolsEnabled = aValue; }
+	inline bool IsDocumentSymbolsEnabled() const { return mDocumentSymbolsEnabled; }
+	inline bool IsIndexingSymbols() const { return mSymbolRangeMin < mSymbolRangeMax || mSymbolBusy || mSymbolsChanged; }
+	int GetIdentifierCount(const std::string& aName) const; // occurrences in the text, once it's indexed
+
+	// brackets in comments and strings are skipped once the colorizer has scanned their lines
+	bool FindMatchingBracket(const Coordinates& aPosition, Coordinates& aOut);
 
 	Coordinates GetCursorPosition() const { return GetActualCursorCoordinates(); }
 	void SetCursorPosition(const Coordinates& aPosition);
@@ -382,6 +482,17 @@ public:
 	void Undo(int aSteps = 1);
 	void Redo(int aSteps = 1);
 
+	// oldest undo steps are dropped once the history grows past this many bytes (0 - unlimited)
+	void SetUndoMemoryBudget(size_t aBytes);
+	inline size_t GetUndoMemoryBudget() const { return mUndoBudget; }
+	inline size_t GetUndoMemoryUsage() const { return mUndoText.size() + mUndoBuffer.size() * sizeof(UndoEntry); }
+
+	// edits made between BeginEdit() and EndEdit() are undone as one step, OnContentUpdate
+	// and colorizing are deferred until the outermost EndEdit() (calls can be nested)
+	void BeginEdit();
+	void EndEdit();
+	inline bool IsInEdit() const { return mEditDepth > 0; }
+
 	inline void SetTabSize(int s) { mTabSize = std::max<int>(0, std::min<int>(32, s)); }
 	inline int GetTabSize() { return mTabSize; }
 
@@ -391,7 +502,8 @@ public:
 	inline void SetSmartIndent(bool s) { mSmartIndent = s; }
 	inline void SetAutoIndentOnPaste(bool s) { mAutoindentOnPaste = s; }
 	inline void SetHighlightLine(bool s) { mHighlightLine = s; }
-	inline void SetCompleteBraces(bool s) { mCompleteBraces = s; }
+	inline void SetHighlightBrackets(bool s) { mHighlightBrackets = s; mBracketHighlightValid = false; }
+	inline void SetCompleteBraces(bool s) { mCompleteBraces = s; mACCandidatesValid = false; }
 	inline void SetHorizontalScroll(bool s) { mHorizontalScroll = s; }
 	inline void SetSmartPredictions(bool s) { mAutocomplete = s; }
 	inline void SetFunctionTooltips(bool s) { mFuncTooltips = s; }
@@ -417,6 +529,11 @@ public:
 	void Colorize(int aFromLine = 0, int aCount = -1);
 	void ColorizeRange(int aFromLine = 0, int aToLine = 0);
 	void ColorizeInternal();
+	inline bool IsColorizing() const { return mCommentRangeMin < mCommentRangeMax || !mColorRanges.empty() || !mColorizerLines.empty(); }
+	inline void SetColorizerTimeBudget(float aMilliseconds) { mColorizerTimeBudget = aMilliseconds; } // UI thread time spent on colorizing per frame
+	inline float GetColorizerTimeBudget() const { return mColorizerTimeBudget; }
+	inline void SetIndexTimeBudget(float aMilliseconds) { mIndexTimeBudget = aMilliseconds; } // UI thread time spent on each of the find and symbol indexes per frame
+	inline float GetIndexTimeBudget() const { return mIndexTimeBudget; }
 
 	struct FunctionData {
 		FunctionData()
@@ -442,11 +559,14 @@ public:
 		mACUserTypes.clear();
 		mACUniforms.clear();
 		mACGlobals.clear();
+		mColorizerSymbols.reset();
+		mACCandidatesValid = false;
 	}
 	inline void ClearAutocompleteEntries()
 	{
 		mACEntries.clear();
 		mACEntrySearch.clear();
+		mACCandidatesValid = false;
 	}
 	inline const std::unordered_map<std::string, FunctionData>& GetAutocompleteFunctions() { return mACFunctions; }
 	inline const std::vector<std::string>& GetAutocompleteUserTypes() { return mACUserTypes; }
@@ -454,24 +574,34 @@ public:
 	inline const std::vector<std::string>& GetAutocompleteGlobals() { return mACGlobals; }
 	inline void AddAutocompleteFunction(const std::string& fname, int lineStart, int lineEnd, const std::vector<std::string>& args, const std::vector<std::string>& locals)
 	{
-		mACFunctions[fname] = FunctionData(lineStart, lineEnd, args, locals);
+		FunctionData data(lineStart, lineEnd, args, locals);
+		EditColorizerSymbols().AddFunction(fname, data);
+		mACFunctions[fname] = data;
+		mACCandidatesValid = false;
 	}
 	inline void AddAutocompleteUserType(const std::string& fname)
 	{
 		mACUserTypes.push_back(fname);
+		EditColorizerSymbols().AddName(fname, PaletteIndex::UserType);
+		mACCandidatesValid = false;
 	}
 	inline void AddAutocompleteUniform(const std::string& fname)
 	{
 		mACUniforms.push_back(fname);
+		EditColorizerSymbols().AddName(fname, PaletteIndex::UniformVariable);
+		mACCandidatesValid = false;
 	}
 	inline void AddAutocompleteGlobal(const std::string& fname)
 	{
 		mACGlobals.push_back(fname);
+		EditColorizerSymbols().AddName(fname, PaletteIndex::GlobalVariable);
+		mACCandidatesValid = false;
 	}
 	inline void AddAutocompleteEntry(const std::string& search, const std::string& display, const std::string& value)
 	{
 		mACEntrySearch.push_back(search);
 		mACEntries.push_back(std::make_pair(display, value));
+		mACCandidatesValid = false;
 	}
 	
 	static const std::vector<Shortcut> GetDefaultShortcuts();
@@ -497,7 +627,19 @@ public:
 	std::function<void(TextEditor*, int)> OnBreakpointRemove;
 	std::function<void(TextEditor*, int, const std::string&, bool)> OnBreakpointUpdate;
 
+	// a single edit: the text in [mStart, mRemovedEnd) (old document) was replaced
+	// with mInserted, which now spans [mStart, mInsertedEnd)
+	struct TextChange
+	{
+		Coordinates mStart;
+		Coordinates mRemovedEnd;
+		Coordinates mInsertedEnd;
+		std::string mInserted;
+		unsigned int mVersion; // document version after this change
+	};
+
 	std::function<void(TextEditor*)> OnContentUpdate;
+	std::function<void(TextEditor*, const TextChange&)> OnTextChange;
 
 	inline void SetPath(const std::string& path) { mPath = path; }
 	inline const std::string& GetPath() { return mPath; }
@@ -506,6 +648,272 @@ private:
 	std::string mPath;
 
 	typedef std::vector<std::pair<std::regex, PaletteIndex>> RegexList;
+
+	// All of the token regexes of a language compiled into a single DFA, so a token is found
+	// in one pass over the text instead of trying every std::regex in turn. Only the regex
+	// subset used by the language definitions is supported, Compile() fails on anything else.
+	class TokenDFA {
+	public:
+		TokenDFA();
+
+		bool Compile(const LanguageDefinition::TokenRegexStrings& aRegexStrings);
+		void Clear();
+		inline bool IsCompiled() const { return !mTransitions.empty(); }
+
+		// the match std::regex (ECMAScript) finds for the first regex (in definition order) that matches
+		// at aBegin: alternatives and repetitions are tried in order, so it isn't always the longest one
+		bool Match(const char* aBegin, const char* aEnd, const char*& aOutEnd, PaletteIndex& aOutColor) const;
+
+	private:
+		static const int MaxPatterns = 32;
+		static const int MaxStates = 4096;
+
+		int mClassCount;
+		uint8_t mClasses[256];
+		std::vector<int> mTransitions; // [state * mClassCount + class], -1 - no transition
+		std::vector<uint32_t> mAccepting; // bit per regex that matches once this state is reached
+		std::vector<PaletteIndex> mColors;
+	};
+
+	// Keywords and known identifiers of a language in a perfect hash table, built once in
+	// SetLanguageDefinition(). Find() hashes and case folds the token in place, so looking
+	// up a word doesn't copy it.
+	class WordTable {
+	public:
+		enum Flags : uint8_t
+		{
+			FlagKeyword = 1 << 0,
+			FlagIdentifier = 1 << 1,
+			FlagPreprocIdentifier = 1 << 2
+		};
+
+		void Build(const LanguageDefinition& aLanguage);
+		uint8_t Find(std::string_view aWord) const; // Flags of the word, 0 if it isn't in the table
+
+	private:
+		uint64_t Hash(std::string_view aWord) const;
+		inline size_t Slot(uint64_t aHash, uint32_t aSeed) const;
+
+		bool mCaseSensitive;
+		std::vector<std::pair<std::string, uint8_t>> mWords;
+		std::vector<uint32_t> mSeeds;	// per bucket, picked so that no two words share a slot
+		std::vector<int> mSlots;		// index into mWords, -1 - empty
+	};
+
+	// Search within one line of text, for the text itself or for an ECMAScript regex. Literal
+	// candidates are the positions where both the first and the last byte of the needle match,
+	// tested 16 at a time with SSE2. Built once per query and shared with the search thread.
+	class TextMatcher {
+	public:
+		enum Flags
+		{
+			FlagIgnoreCase = 1 << 0,	// ASCII letters only
+			FlagWholeWord = 1 << 1,		// matches don't start or end inside of an identifier
+			FlagRegex = 1 << 2
+		};
+
+		TextMatcher(const std::string& aText, int aFlags = 0);
+
+		inline const std::string& GetText() const { return mText; }
+		inline int GetFlags() const { return mFlags; }
+		inline bool IsValid() const { return mValid; } // false for an empty text or a regex that doesn't compile
+
+		// first non-empty match that starts at or after aFrom in the line [aBegin, aEnd)
+		bool Find(const char* aBegin, const char* aEnd, const char* aFrom, const char*& aOutStart, const char*& aOutEnd) const;
+
+	private:
+		const char* FindLiteral(const char* aFrom, const char* aEnd) const;
+
+		std::string mText;
+		std::string mNeedle; // mText, lower case with FlagIgnoreCase
+		int mFlags;
+		bool mValid;
+		std::regex mRegex;
+	};
+
+	// read-only data used for colorizing, shared with the colorizer thread
+	struct ColorizerLanguage
+	{
+		LanguageDefinition::TokenizeCallback mTokenize;
+		bool mCaseSensitive;
+		WordTable mWords;
+		TokenDFA mTokenDFA;
+		RegexList mRegexList; // only used when mTokenDFA couldn't be compiled
+	};
+
+	// identifiers from the autocomplete data: names are hashed, arguments and locals
+	// are found through the line range of the function that declares them
+	class ColorizerSymbols
+	{
+	public:
+		void AddFunction(const std::string& aName, const FunctionData& aData);
+		void AddName(const std::string& aName, PaletteIndex aColor);
+		bool Find(std::string_view aName, bool aCaseSensitive, int aLine, PaletteIndex& aOutColor) const; // aName is compared in upper case if !aCaseSensitive
+
+	private:
+		struct Scope
+		{
+			int mStart, mEnd;	// lines, inclusive
+			int mMaxEnd;		// largest mEnd of this and all previous scopes
+			int mFunction;
+			PaletteIndex mColor;
+		};
+		typedef std::vector<Scope> Scopes; // sorted by mStart
+
+		struct Symbol
+		{
+			std::string mName;
+			PaletteIndex mColor;	// functions, uniforms, globals and user types, Default - none
+			Scopes mScopes;			// arguments and locals
+		};
+		typedef std::unordered_multimap<size_t, Symbol> Symbols; // by the hash of the name, so tokens are looked up without a copy
+
+		Symbols::const_iterator FindSymbol(std::string_view aName) const;
+		Symbols::iterator FindSymbol(const std::string& aName);
+		Symbol& GetSymbol(const std::string& aName);
+		void AddScope(const std::string& aName, const Scope& aScope);
+		void RemoveScopes(const std::string& aName, int aFunction);
+		static void UpdateMaxEnd(Scopes& aScopes);
+
+		Symbols mSymbols;
+		std::unordered_map<std::string, std::pair<int, FunctionData>> mFunctions; // id used in Scope::mFunction, declaration
+	};
+
+	// ids anchored to lines that move with the text: the lines are stored as the distance to the
+	// previous entry, so moving every line below an edit is a single update of the Fenwick tree
+	class LineDecorations
+	{
+	public:
+		// walks the lines in order, one entry at a time
+		struct Cursor
+		{
+			int mIndex;
+			int mLine;
+		};
+
+		LineDecorations();
+
+		void Assign(const std::vector<std::pair<int, int>>& aSorted); // (line, id) pairs sorted by line
+		void Add(int aLine, int aId);
+		int Remove(int aLine);	// id of the removed entry, -1 - there was none
+		int Find(int aLine) const;
+		void Erase(int aFromLine, int aToLine, std::vector<std::pair<int, int>>* aOutRemoved = nullptr);
+		void Shift(int aFromLine, int aDelta); // the lines in between must be empty when moving up
+		void GetRange(int aFromLine, int aToLine, std::vector<std::pair<int, int>>& aOut) const; // (line, id) pairs
+		inline int GetCount() const { return mCount; }
+
+		Cursor Seek(int aLine) const;
+		int Next(Cursor& aCursor, int aLine) const; // id on aLine, for increasing aLine
+
+	private:
+		struct Entry
+		{
+			int mGap;	// line minus the line of the previous entry
+			int mId;	// -1 - removed, kept until Compact()
+		};
+
+		int GetLine(int aIndex) const;
+		int LowerBound(int aLine) const; // first entry on aLine or below it
+		void AddGap(int aIndex, int aDelta);
+		void Build();
+		void Compact();
+
+		std::vector<Entry> mEntries;
+		std::vector<int> mTree; // Fenwick tree over mGap
+		int mCount;				// entries that aren't removed
+	};
+	void MoveDecorations(const Coordinates& aStart, const Coordinates& aRemovedEnd, const Coordinates& aInsertedEnd);
+
+	// what is drawn in one pixel row of the scrollbar, higher values win
+	enum ScrollbarMarker : uint8_t
+	{
+		ScrollbarMarkerNone,
+		ScrollbarMarkerBreakpoint,
+		ScrollbarMarkerError
+	};
+	void BuildScrollbarMarkers(int aRows);
+	void RenderScrollbarMarkers(ImDrawList* aDrawList, const ImVec2& aMin, const ImVec2& aMax);
+
+	// copy of a line range that is colorized on the colorizer thread
+	struct ColorizeJob
+	{
+		int mFromLine;
+		unsigned int mVersion; // document version when the copy was made
+		std::string mText;
+		std::vector<uint8_t> mPreprocessor;
+		std::vector<int> mLineEnds;
+		std::vector<PaletteIndex> mColors;
+		std::shared_ptr<const ColorizerLanguage> mLanguage;
+		std::shared_ptr<const ColorizerSymbols> mSymbols;
+		int mThreadCount;
+		double mSeconds; // time spent colorizing, filled in by the colorizer thread
+	};
+
+	// helper threads of the colorizer thread, started on first use and kept for the following jobs
+	class ColorizerPool
+	{
+	public:
+		~ColorizerPool();
+
+		void Run(int aCount, const std::function<void(int)>& aTask); // calls aTask(0 .. aCount - 1), 0 on the calling thread
+
+	private:
+		void Worker(int aIndex);
+
+		std::vector<std::thread> mThreads;
+		std::mutex mMutex;
+		std::condition_variable mStartCondition;
+		std::condition_variable mDoneCondition;
+		const std::function<void(int)>* mTask = nullptr;
+		int mTaskCount = 0;
+		int mPending = 0; // workers still running the task
+		unsigned int mGeneration = 0;
+		bool mExit = false;
+	};
+
+	// every shared language definition and its compiled colorizer data, for all editors
+	struct SharedLanguage
+	{
+		std::weak_ptr<const LanguageDefinition> mDefinition;
+		std::shared_ptr<const ColorizerLanguage> mColorizer; // compiled on first use
+	};
+	struct SharedLanguages
+	{
+		std::mutex mMutex;
+		std::unordered_map<const LanguageDefinition*, SharedLanguage> mLanguages;
+	};
+	static SharedLanguages& GetSharedLanguages();
+	static std::shared_ptr<const ColorizerLanguage> GetSharedColorizerLanguage(const std::shared_ptr<const LanguageDefinition>& aLanguageDef);
+
+	static void ColorizeLine(const ColorizerLanguage& aLanguage, const ColorizerSymbols& aSymbols, int aLine, const char* aBegin, const char* aEnd, const uint8_t* aPreprocessor, PaletteIndex* aOutColors);
+	std::shared_ptr<const ColorizerSymbols> GetColorizerSymbols();
+	ColorizerSymbols& EditColorizerSymbols();
+	void AddColorRange(int aFromLine, int aToLine);
+	void RemoveColorRange(int aFromLine, int aToLine);
+	void NextColorRange(int aMaxLines, int& aFromLine, int& aToLine) const;
+	int SubmitColorizeJob(int aFromLine, int aToLine, size_t aMaxBytes, const std::chrono::steady_clock::time_point& aDeadline);
+	void ApplyColorizeJob(const ColorizeJob& aJob);
+	static void RunColorizeJob(ColorizeJob& aJob, ColorizerPool& aPool);
+	void ColorizerThread();
+	int GetColorizerWorkerCount() const;
+
+	// jobs are sized by text rather than by the frame's time budget, and the next one is already
+	// queued when the colorizer thread finishes, so it isn't idle between frames
+	static const int ColorizerJobBytes = 256 * 1024;	// per worker
+	static const int ColorizerRegexJobBytes = 4 * 1024;	// per worker, for languages colorized with std::regex
+	static const int MaxColorizerJobs = 2;				// submitted and not applied yet
+
+	enum LineState : uint8_t
+	{
+		LineStateBlockComment = 1 << 0,
+		LineStateString = 1 << 1,
+		LineStateConcatenate = 1 << 2,	// previous line ended with '\'
+		LineStateSingleLineComment = 1 << 3,
+		LineStatePreprocessor = 1 << 4,
+		LineStateFirstChar = 1 << 5,
+		LineStateInvalid = 0xFF			// not scanned yet
+	};
+	uint8_t ScanLineComments(int aLine, uint8_t aState);
 	
 	struct EditorState
 	{
@@ -547,10 +955,105 @@ private:
 		EditorState mAfter;
 	};
 
-	typedef std::vector<UndoRecord> UndoBuffer;
+	// Compact form of an UndoRecord as it is kept in the undo history.
+	// The added/removed text lives in mUndoText and is referenced by offset.
+	struct UndoEntry
+	{
+		unsigned int mAddedOffset, mAddedLength;
+		unsigned int mRemovedOffset, mRemovedLength;
+
+		Coordinates mAddedStart;
+		Coordinates mAddedEnd;
+		Coordinates mRemovedStart;
+		Coordinates mRemovedEnd;
+
+		EditorState mBefore;
+		EditorState mAfter;
+
+		bool mMergeable;
+		bool mGrouped; // undone/redone together with the previous entry
+	};
+
+	typedef std::vector<UndoEntry> UndoBuffer;
 
 	void ProcessInputs();
 	float TextDistanceToLineStart(const Coordinates& aFrom) const;
+
+	// measured layout of a visible line, kept until the line's text or colors change
+	struct LineLayout
+	{
+		struct Run
+		{
+			int mGlyph;					// first glyph, gives the color and position of the run
+			int mTextStart, mTextEnd;	// range in mText
+		};
+
+		struct Tab
+		{
+			int mGlyph;
+			int mColumnAfter;
+		};
+
+		bool mValid = false;
+		bool mMonospace = false;		// ASCII text in a monospace font, positions follow from the columns
+		int mGlyphCount = 0;
+		std::vector<float> mOffsets;	// distance of every glyph from the line start, plus the line width (not monospace)
+		std::vector<Tab> mTabs;			// (monospace)
+		std::string mText;				// the line without spaces and tabs
+		std::vector<Run> mRuns;			// text drawn with one color
+
+		// geometry of the text and whitespace markers, drawn at mVertexPos
+		bool mVertexValid = false;
+		ImVec2 mVertexPos;
+		float mVertexClipX = 0.0f, mVertexClipWidth = 0.0f; // horizontal clipping the glyphs were culled with
+		std::vector<ImDrawVert> mVertices;
+		std::vector<ImDrawIdx> mIndices; // relative to mVertices
+	};
+	void UpdateLineLayouts(int aFromLine, int aToLine);
+	void InvalidateLineLayouts(int aFromLine, int aToLine);
+	const LineLayout& GetLineLayout(int aLine);
+	const LineLayout* FindLineLayout(int aLine, bool aCheckFont) const;
+	int GetLayoutColumn(const LineLayout& aLayout, int aIndex) const;
+	int GetLayoutIndex(const LineLayout& aLayout, int aColumn) const;
+	float GetLayoutOffset(const LineLayout& aLayout, int aIndex) const;
+	int HitTestLineLayout(int aLine, const LineLayout& aLayout, float aX, int& aOutTabs) const;
+	void RenderLineLayout(ImDrawList* aDrawList, int aLine, const ImVec2& aPos, float aSpaceSize);
+	bool FindText(const TextMatcher& aMatcher, const Coordinates& aFrom, Coordinates& aOutStart, Coordinates& aOutEnd);
+	int ReplaceAll(const TextMatcher& aMatcher, const std::string& aReplace); // single line replacement, returns the number of replacements
+	const std::shared_ptr<const TextMatcher>& GetFindMatcher();
+
+	// every match of the find bar text, searched again line by line as the text changes
+	struct FindMatch
+	{
+		int mStart, mEnd; // glyph indices
+	};
+	void UpdateFindIndex(const std::shared_ptr<const TextMatcher>& aMatcher, const std::chrono::steady_clock::time_point& aDeadline);
+	void SetFindIndexMatcher(const std::shared_ptr<const TextMatcher>& aMatcher);
+	void CompleteFindIndex(const std::shared_ptr<const TextMatcher>& aMatcher);
+	void ClearFindIndex();
+	inline bool IsFindIndexComplete() const { return mFindRangeMin >= mFindRangeMax && !mSearchBusy; }
+	void BuildFindMatchTree();
+	void AddFindMatches(int aLine, int aCount);
+	int GetFindMatchesBefore(int aLine);	// number of matches in the lines before aLine
+	int GetFindMatchLine(int aIndex);		// line of the aIndex-th match
+	bool FindIndexed(const Coordinates& aFrom, bool aBackwards, Coordinates& aOutStart, Coordinates& aOutEnd);
+
+	// copy of a line range that is searched on the search thread
+	struct SearchJob
+	{
+		int mFromLine;
+		int mGeneration;	// the job is abandoned once mSearchGeneration moves past it
+		bool mCancelled;
+		std::shared_ptr<const TextMatcher> mMatcher;
+		std::string mText;
+		std::vector<int> mLineEnds;
+		std::vector<int> mMatchEnds; // per line, end of its matches in mMatches
+		std::vector<FindMatch> mMatches;
+	};
+	std::unique_ptr<SearchJob> CreateSearchJob(int aMaxBytes, const std::chrono::steady_clock::time_point& aDeadline);
+	void ApplySearchJob(const SearchJob& aJob);
+	void RunSearchJob(SearchJob& aJob) const;
+	void SearchThread();
 	void EnsureCursorVisible();
 	int GetPageSize() const;
 	std::string GetText(const Coordinates& aStart, const Coordinates& aEnd) const;
@@ -560,6 +1063,13 @@ private:
 	void DeleteRange(const Coordinates& aStart, const Coordinates& aEnd);
 	int InsertTextAt(Coordinates& aWhere, const char* aValue, bool indent = false);
 	void AddUndo(UndoRecord& aValue);
+	void ReplaceSelection(const char* aValue, bool aIndent = false);
+	void NotifyContentUpdate();
+	void NotifyTextChange(const Coordinates& aStart, const Coordinates& aRemovedEnd, const Coordinates& aInsertedEnd, bool aMoveDecorations = true);
+	bool IsMergeableUndo(const UndoRecord& aValue) const;
+	bool MergeUndo(UndoRecord& aValue);
+	void TrimUndo();
+	UndoRecord GetUndoRecord(int aIndex) const;
 	Coordinates ScreenPosToCoordinates(const ImVec2& aPosition) const;
 	Coordinates MousePosToCoordinates(const ImVec2& aPosition) const;
 	ImVec2 CoordinatesToScreenPos(const TextEditor::Coordinates& aPosition) const;
@@ -574,6 +1084,7 @@ private:
 	void RemoveLine(int aStart, int aEnd);
 	void RemoveLine(int aIndex);
 	Line& InsertLine(int aIndex);
+	inline Line CreateLine() const { return Line(LineAllocator<Glyph>(mLineArena.get())); }
 	void EnterCharacter(ImWchar aChar, bool aShift);
 	void Backspace();
 	void DeleteSelection();
@@ -598,11 +1109,19 @@ private:
 	}
 
 	float mLineSpacing;
+	std::unique_ptr<LineArena> mLineArena; // must outlive mLines
 	Lines mLines;
 	EditorState mState;
 	UndoBuffer mUndoBuffer;
+	std::string mUndoText;
+	size_t mUndoBudget;
 	int mUndoIndex;
-	int mReplaceIndex;
+	int mEditDepth;
+	int mEditUndoCount;
+	bool mEditChanged;
+	std::vector<TextChange> mEditChanges;
+	unsigned int mVersion;
+	Coordinates mReplacePosition;
 
 	bool mSidebar;
 	bool mHasSearch;
@@ -614,6 +1133,24 @@ private:
 	bool mFindFocused, mReplaceFocused;
 	bool mReplaceOpened;
 	char mReplaceWord[256];
+	int mFindFlags; // TextMatcher::Flags
+	std::string mFindLine; // bytes of the line being searched
+	std::shared_ptr<const TextMatcher> mFindMatcher; // for mFindWord and mFindFlags
+	std::shared_ptr<const TextMatcher> mFindIndexMatcher; // null - no index
+	std::vector<std::vector<FindMatch>> mFindMatches; // per line
+	std::vector<int> mFindMatchTree; // Fenwick tree over the match counts of the lines
+	bool mFindMatchTreeValid;
+	int mFindMatchCount;
+	int mFindRangeMin, mFindRangeMax; // lines that still have to be searched
+	std::thread mSearchThread;
+	std::mutex mSearchMutex;
+	std::condition_variable mSearchCondition;
+	std::unique_ptr<SearchJob> mSearchJob;		// waiting for the search thread
+	std::unique_ptr<SearchJob> mSearchResult;	// finished, applied in UpdateFindIndex()
+	std::atomic<int> mSearchGeneration;
+	bool mSearchBusy;
+	bool mSearchExit;
+	int mSearchLineStart, mSearchLineEnd; // lines of the job on the search thread
 
 	std::vector<std::string> mACEntrySearch;
 	std::vector<std::pair<std::string, std::string>> mACEntries;
@@ -628,11 +1165,125 @@ private:
 
 	bool m_requestAutocomplete, m_readyForAutocomplete;
 	void m_buildSuggestions(bool* keepACOpened = nullptr);
+
+	// everything autocomplete can suggest, with the lower case text it's found by
+	struct ACCandidate
+	{
+		std::string mKey;
+		uint64_t mChars;			// ACCharMask() of mKey
+		std::string mDisplay, mValue;
+		int mLineStart, mLineEnd;	// lines it's suggested on, for arguments and locals
+		int mCount;					// occurrences, for the words of the document
+	};
+	void BuildACCandidates();
+
+	// identifiers and declarations of one line, outside of comments and strings
+	struct LineSymbols
+	{
+		std::vector<std::string> mNames;		// every identifier, counted in mSymbolCounts
+		std::vector<std::string> mDeclared;		// "type name" followed by one of = ; , [ :
+		std::vector<std::string> mTypes;		// after struct, class or cbuffer
+		std::string mFunction;					// "type name(...)" followed by nothing but a semantic or the body
+		std::vector<std::string> mArguments;
+		bool mFunctionOpens = false;			// the body starts on this line
+		bool mUniform = false;					// mDeclared are uniforms
+		bool mUniformBlock = false;				// cbuffer, or a GLSL uniform block
+		char mFirstChar = 0;					// 0 - the line is empty
+		int mBraceDelta = 0, mBraceMin = 0, mBraceMax = 0; // '{' minus '}' at the end of the line, lowest and highest on the way
+	};
+	// copy of a line range that is scanned on the symbol thread
+	struct SymbolJob
+	{
+		int mFromLine;
+		int mGeneration;
+		bool mCancelled;
+		std::string mText; // comments are blanked out
+		std::vector<int> mLineEnds;
+		std::vector<LineSymbols> mLines;
+	};
+	// declarations found in the whole text, line numbers start at 1 like in the autocomplete data
+	struct DocumentSymbols
+	{
+		std::vector<std::pair<std::string, FunctionData>> mFunctions;
+		std::vector<std::string> mTypes, mUniforms, mGlobals;
+	};
+	static void ScanLineSymbols(const char* aBegin, const char* aEnd, LineSymbols& aOut);
+	void UpdateSymbolIndex(const std::chrono::steady_clock::time_point& aDeadline);
+	void ClearSymbolIndex();
+	void CountSymbols(const LineSymbols& aLine, int aSign);
+	std::unique_ptr<SymbolJob> CreateSymbolJob(int aMaxBytes, const std::chrono::steady_clock::time_point& aDeadline);
+	void ApplySymbolJob(SymbolJob& aJob);
+	void RunSymbolJob(SymbolJob& aJob) const;
+	void SymbolThread();
+	void BuildDocumentSymbols();
+
+	// depth changes of the brackets in a line range for every kind of bracket, opening brackets count as +1
+	static const int BracketKinds = 3; // (), [] and {}
+	struct BracketSpan
+	{
+		int mDepth[BracketKinds] = {};
+		int mMinDepth[BracketKinds] = {};	// lowest depth going forward from the start of the range
+		int mMaxSuffix[BracketKinds] = {};	// highest depth of a range that ends where this one ends
+	};
+	// spans of consecutive lines, a line is added or removed without touching the other blocks
+	struct BracketBlock
+	{
+		std::vector<BracketSpan> mLines;
+		BracketSpan mSpan;		// all of mLines
+		bool mChanged = false;	// mSpan has to be merged again
+	};
+	static const int BracketBlockSize = 256; // lines in a new block, blocks are split at twice that
+	static BracketSpan MergeBracketSpans(const BracketSpan& aLeft, const BracketSpan& aRight);
+	void ScanLineBrackets(int aLine, std::vector<int>& aOut) const; // indices of the brackets outside of comments and strings
+	void UpdateBracketIndex();
+	void BuildBracketTree();
+	void ResetBracketBlocks();
+	void SpliceBracketLines(int aLine, int aRemoved, int aInserted);
+	int FindBracketBlock(int aLine) const;
+	int FindBracketBlockAfter(int aKind, int aNode, int aFrom, int aTo, int aBlock, int& aDepth) const;
+	int FindBracketBlockBefore(int aKind, int aNode, int aFrom, int aTo, int aBlock, int& aDepth) const;
+	int FindBracketLineAfter(int aKind, int aLine, int& aDepth) const;
+	int FindBracketLineBefore(int aKind, int aLine, int& aDepth) const;
+	bool FindBracketMatch(int aLine, int aIndex, int& aOutLine, int& aOutIndex);
+	void UpdateBracketHighlight();
 	bool mActiveAutocomplete;
 	bool mAutocomplete;
 	std::unordered_map<std::string, FunctionData> mACFunctions;
 	std::vector<std::string> mACUserTypes, mACUniforms, mACGlobals;
 	std::string mACWord;
+	std::vector<ACCandidate> mACCandidates;
+	bool mACCandidatesValid;
+	std::vector<int> mACMatches;	// candidates whose key contains mACMatchWord, narrowed while the word grows
+	std::string mACMatchWord;
+	int mACMatchLine;				// -1 - mACMatches has to be searched again
+	bool mACDocumentChanged;		// the document symbols are added to mACCandidates when the next word is started
+
+	bool mDocumentSymbolsEnabled;
+	std::vector<LineSymbols> mSymbolLines;
+	std::unordered_map<std::string, int> mSymbolCounts;
+	DocumentSymbols mDocumentSymbols;
+	bool mSymbolsChanged; // mDocumentSymbols has to be built again once every line is scanned
+	int mSymbolRangeMin, mSymbolRangeMax; // lines that still have to be scanned
+	std::thread mSymbolThread;
+	std::mutex mSymbolMutex;
+	std::condition_variable mSymbolCondition;
+	std::unique_ptr<SymbolJob> mSymbolJob;		// waiting for the symbol thread
+	std::unique_ptr<SymbolJob> mSymbolResult;	// finished, applied in UpdateSymbolIndex()
+	std::atomic<int> mSymbolGeneration;
+	bool mSymbolBusy;
+	bool mSymbolExit;
+	int mSymbolLineStart, mSymbolLineEnd; // lines of the job on the symbol thread
+
+	std::vector<BracketBlock> mBracketBlocks;
+	std::vector<int> mBracketBlockStart;	// first line of every block
+	int mBracketLineCount;					// lines in mBracketBlocks
+	std::vector<BracketSpan> mBracketTree;	// segment tree over the block spans, the leaves start at mBracketLeaves
+	int mBracketLeaves;
+	int mBracketRangeMin, mBracketRangeMax;	// lines that have to be scanned again
+	bool mHighlightBrackets;
+	std::pair<int, int> mBracketHighlight[2];	// line and character index of the brackets around the cursor, -1 if none
+	Coordinates mBracketHighlightCursor;
+	bool mBracketHighlightValid;				// found again when the cursor moves or lines are scanned again
 	std::vector<std::pair<std::string, std::string>> mACSuggestions;
 	int mACIndex;
 	bool mACOpened;
@@ -660,7 +1311,10 @@ private:
 	float mTextStart;                   // position (in pixels) where a code line starts relative to the left of the TextEditor.
 	int  mLeftMargin;
 	bool mCursorPositionChanged;
-	int mColorRangeMin, mColorRangeMax;
+	std::vector<std::pair<int, int>> mColorRanges; // sorted, non-overlapping [from, to) line ranges waiting to be colorized
+	int mVisibleLineStart, mVisibleLineEnd; // lines drawn in the last frame, colorized first
+	float mColorizerTimeBudget;
+	float mIndexTimeBudget;
 	SelectionMode mSelectionMode;
 	bool mHandleKeyboardInputs;
 	bool mHandleMouseInputs;
@@ -670,8 +1324,19 @@ private:
 
 	Palette mPaletteBase;
 	Palette mPalette;
-	LanguageDefinition mLanguageDefinition;
-	RegexList mRegexList;
+	std::shared_ptr<const LanguageDefinition> mLanguageDefinition;
+
+	std::shared_ptr<const ColorizerLanguage> mColorizerLanguage;
+	std::shared_ptr<ColorizerSymbols> mColorizerSymbols; // copied before a change while a colorizer job still uses it
+	std::thread mColorizerThread;
+	std::mutex mColorizerMutex;
+	std::condition_variable mColorizerCondition;
+	std::deque<std::unique_ptr<ColorizeJob>> mColorizerJobs;		// waiting for the colorizer thread
+	std::deque<std::unique_ptr<ColorizeJob>> mColorizerResults;	// finished, applied in order in ColorizeInternal()
+	std::deque<std::pair<int, int>> mColorizerLines; // lines of every job not applied yet, oldest first, emptied when the text changes
+	bool mColorizerExit;
+	int mColorizerThreadCount;
+	double mColorizerLinesPerSecond;
 
 	float mDebugBarWidth, mDebugBarHeight;
 
@@ -679,18 +1344,36 @@ private:
 	int mDebugCurrentLine;
 	ImVec2 mUICursorPos, mFindOrigin;
 	float mWindowWidth;
-	std::vector<Breakpoint> mBreakpoints;
+	LineDecorations mBreakpointLines;		// ids in mBreakpointData, lines start at 0
+	std::vector<Breakpoint> mBreakpointData;	// mLine is updated when it's returned
+	std::vector<int> mBreakpointFree;
+	std::vector<Breakpoint> mBreakpoints;		// returned by GetBreakpoints()
 	ImVec2 mRightClickPos;
 
 	int mPopupCondition_Line;
 	bool mPopupCondition_Use;
 	char mPopupCondition_Condition[512];
 
-	bool mCheckComments;
-	ErrorMarkers mErrorMarkers;
+	int mCommentRangeMin, mCommentRangeMax;
+	std::vector<uint8_t> mLineStates; // LineState flags at the start of every line
+	LineDecorations mErrorLines;			// ids in mErrorMessages, lines start at 0
+	std::vector<std::string> mErrorMessages;
+	std::vector<uint8_t> mScrollbarMarkerRows; // ScrollbarMarker for every pixel row of the scrollbar
+	int mScrollbarMarkerLines;				// line count mScrollbarMarkerRows was built for
+	bool mScrollbarMarkersDirty;
 	ImVec2 mCharAdvance;
 	Coordinates mInteractiveStart, mInteractiveEnd;
-	std::string mLineBuffer;
+	std::vector<LineLayout> mLineLayouts; // for the lines in view, starting at mLineLayoutStart
+	int mLineLayoutStart;
+	ImFont* mLineLayoutFont;
+	float mLineLayoutFontSize;
+	int mLineLayoutTabSize;
+	float mLineLayoutAdvance;
+	bool mLineLayoutMonospace;
+	Palette mLineLayoutPalette;		// colors and settings of the cached line geometry
+	ImDrawListFlags mLineLayoutDrawFlags;
+	bool mLineLayoutWhitespaces;
+	bool mLineLayoutColorizer;
 	uint64_t mStartTime;
 
 	Coordinates mLastHoverPosition;